@@ -0,0 +1,187 @@
+/**
+  Batch of runs in one process: each run overrides some of the settings. The runs are shared among
+  batch.concurrent groups, performed concurrently, the runs of a group one after the other. The runs
+  of a group share its mesh, its reordering and its demag solver, which are built once: the first
+  group uses the ones of the simulation, the others their own copies.
+ */
+
+#include <numeric>
+#include <signal.h>
+
+#include "demagSolver.h"
+#include "fem.h"
+#include "time_integration.h"
+
+/** \return the settings of run k: the documents of the batch settings read again, then the
+ * overrides of the run. The threads are shared among the nbGroups concurrent groups */
+static std::unique_ptr<Settings> runSettings(Settings const &settings, const unsigned int k,
+                                             const int nbGroups)
+    {
+    auto run = std::make_unique<Settings>();
+    run->verbose = settings.verbose;
+    run->setFileDisplayName(settings.getFileDisplayName());
+    for (YAML::Node const &doc : settings.getDocuments())
+        run->read(doc);
+    run->read(settings.batchRuns[k]);
+    run->batchRuns.clear();
+    YAML::Node outputs = settings.batchRuns[k]["outputs"];
+    if (!outputs || !outputs["file_basename"])
+        run->setSimName(settings.getSimName() + "_run" + std::to_string(k));
+    run->solverNbTh = std::max(1, settings.solverNbTh / nbGroups);
+    run->scalfmmNbTh = std::max(1, settings.scalfmmNbTh / nbGroups);
+    // the evaluators of concurrent images read the mesh again
+    if (nbGroups > 1) run->gnebConcurrent = 1;
+    return run;
+    }
+
+/** mesh and demag solver of a group of runs */
+struct Group
+    {
+    Fem *fem;               /**< mesh, reset by each run */
+    demagSolver *demagSol;  /**< demag solver */
+    std::unique_ptr<Fem> ownFem;               /**< copy of the mesh, if not the shared one */
+    std::unique_ptr<demagSolver> ownDemagSol;  /**< demag solver, if not the shared one */
+    };
+
+/** summary of a run, for the batch file */
+struct RunResult
+    {
+    int status = -1;  /**< status of the run, -1 if not performed */
+    int iter = 0;     /**< iterations or time steps */
+    double t = 0;     /**< final time */
+    Eigen::Vector3d M = Eigen::Vector3d::Zero(); /**< final average magnetization */
+    double Etot = 0;  /**< final total energy */
+    };
+
+/** \return what a run changes in the data shared by the batch, empty if nothing */
+static std::string sharedDataChange(Settings const &settings, Settings const &run)
+    {
+    if (run.getPbName() != settings.getPbName()) return "mesh.filename";
+    if (run.getScale() != settings.getScale()) return "mesh.length_unit";
+    if (run.paramTetra.size() != settings.paramTetra.size()
+        || run.paramFacette.size() != settings.paramFacette.size())
+        return "the regions of the mesh";
+    if (run.demagMethod != settings.demagMethod) return "demagnetizing_field_solver";
+    if (run.periodic != settings.periodic) return "periodic_boundary_conditions";
+    if (run.getProbes().size() != settings.getProbes().size()) return "probes";
+    if (run.recenter != settings.recenter) return "recentering";
+    if (run.r_path_output_dir != settings.r_path_output_dir) return "outputs.directory";
+    return "";
+    }
+
+/** \return what makes a run read a mesh, which is not thread safe, empty if nothing */
+static std::string meshReading(Settings const &run)
+    {
+    if (!run.restoreMeshName.empty()) return "initial_magnetization from another mesh";
+    if (!run.multiresMeshes.empty()) return "multiresolution";
+    if (run.simMode == PARAREAL) return "the parareal mode";
+    return "";
+    }
+
+int batch(Fem &fem, Settings &settings, demagSolver &demagSol, int &nt,
+          std::function<int(Fem &, Settings &, demagSolver &, timing &, int &)> const &simulate)
+    {
+    const std::string baseName = settings.r_path_output_dir + '/' + settings.getSimName();
+    const unsigned int nb_runs = settings.batchRuns.size();
+    const int nbGroups = std::min<int>(settings.batchConcurrent, nb_runs);
+
+    // all the runs are checked before the first one starts, and get their seeds in run order
+    std::vector<std::unique_ptr<Settings>> runs(nb_runs);
+    for (unsigned int k = 0; k < nb_runs; k++)
+        {
+        runs[k] = runSettings(settings, k, nbGroups);
+        runs[k]->setSeed(rand());
+        std::string change = sharedDataChange(settings, *runs[k]);
+        if (!change.empty())
+            {
+            std::cerr << "Fatal Error: batch run " << k << " cannot change " << change << ".\n";
+            exit(1);
+            }
+        std::string reading = meshReading(*runs[k]);
+        if (nbGroups > 1 && !reading.empty())
+            {
+            std::cerr << "Fatal Error: batch run " << k << " cannot use " << reading
+                      << " with concurrent groups.\n";
+            exit(1);
+            }
+        }
+
+    std::string str = baseName + "_batch.evol";
+    std::ofstream fout(str);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    fout << settings.columnsMetadata("run\tstatus\titer\tt\t<Mx>\t<My>\t<Mz>\tE_tot");
+    fout.precision(16);
+
+    // the groups are built one after the other: reading a mesh is not thread safe
+    std::vector<Group> groups(nbGroups);
+    groups[0].fem = &fem;
+    groups[0].demagSol = &demagSol;
+    for (int g = 1; g < nbGroups; g++)
+        {
+        Settings &run = *runs[g];  // the first run of the group, for the threads of scalfmm
+        timing t_prm(run.tf, run.dt_min, run.dt_max);
+        groups[g].ownFem = std::make_unique<Fem>(run, t_prm);
+        groups[g].ownDemagSol = makeDemagSolver(run, groups[g].ownFem->msh);
+        groups[g].fem = groups[g].ownFem.get();
+        groups[g].demagSol = groups[g].ownDemagSol.get();
+        }
+
+    std::cout << "Batch of " << nb_runs << " runs, " << nbGroups << " concurrent groups\n";
+    std::vector<RunResult> results(nb_runs);
+    std::vector<int> groupIdx(nbGroups);
+    std::iota(groupIdx.begin(), groupIdx.end(), 0);
+    std::for_each(EXEC_POL, groupIdx.begin(), groupIdx.end(),
+                  [&](const int g)
+                  {
+                      Fem &groupFem = *groups[g].fem;
+                      demagSolver &groupDemagSol = *groups[g].demagSol;
+                      for (unsigned int k = g; k < nb_runs; k += nbGroups)
+                          {
+                          extern volatile sig_atomic_t received_signal;  // set by signal_handler()
+                          if (received_signal) break;
+
+                          Settings &run = *runs[k];
+                          std::cout << "\nbatch run " << k << ": " << run.getSimName() << std::endl;
+                          if (run.verbose && nbGroups == 1) run.toYaml();
+                          groupDemagSol.prmTetra = run.paramTetra;
+                          groupDemagSol.prmFacette = run.paramFacette;
+                          timing t_prm(run.tf, run.dt_min, run.dt_max);
+                          groupFem.reset(run, t_prm);
+
+                          RunResult &r = results[k];
+                          r.status = simulate(groupFem, run, groupDemagSol, t_prm, r.iter);
+                          groupFem.energy(t_prm.get_t(), run);
+                          r.t = t_prm.get_t();
+                          r.M = Eigen::Vector3d(groupFem.msh.avg(Nodes::get_u_comp, Nodes::IDX_X),
+                                                groupFem.msh.avg(Nodes::get_u_comp, Nodes::IDX_Y),
+                                                groupFem.msh.avg(Nodes::get_u_comp, Nodes::IDX_Z));
+                          r.Etot = groupFem.Etot;
+                          runs[k].reset();  // release the expression parsers of the run
+                          }
+                  });
+
+    int status(0);
+    nt = 0;
+    for (unsigned int k = 0; k < nb_runs; k++)
+        {
+        RunResult const &r = results[k];
+        if (r.status < 0)  // not performed, the batch was stopped by a signal
+            {
+            status = 1;
+            continue;
+            }
+        nt += r.iter;
+        if (r.status != 0) status = 1;
+        fout << k << '\t' << r.status << '\t' << r.iter << '\t' << r.t << '\t' << r.M.x() << '\t'
+             << r.M.y() << '\t' << r.M.z() << '\t' << r.Etot << std::endl;
+        }
+    fout.close();
+    extern volatile sig_atomic_t received_signal;  // set by signal_handler() in main.cpp
+    if (received_signal) std::cout << "\nReceived signal: the batch was stopped.\n";
+    std::cout << "\nBatch summary saved to " << str << "\n";
+    return status;
+    }
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+
+import os
+import sys
+import json
+import subprocess
+import timeit
+from datetime import datetime
+from feellgood.meshMaker import Cylinder, Cuboid
+
+def makeSettings(mesh, surface_name, volume_name, nbThreads, final_time, method, tol, cells,
+                 output_dir):
+    """ returns a dictionary of settings for feellgood input, demag computed with method """
+    settings = {
+        "outputs": {
+            "directory": output_dir,
+            "file_basename": "demag_benchmark",
+            "evol_time_step": 1e-12,
+            "final_time": final_time,
+            "evol_columns": ["t", "<Mx>", "<My>", "<Mz>", "E_demag", "E_tot"],
+            "mag_config_every": False
+        },
+        "mesh": {
+            "filename": mesh,
+            "length_unit": 1e-9, # we use nanometers
+            "volume_regions": { volume_name: {} },
+            "surface_regions": { surface_name: {} }
+        },
+        "initial_magnetization": [1, 0, 1],
+        "Bext": [0, 0, 0],
+        "demagnetizing_field_solver": {
+            "nb_threads": nbThreads,
+            "method": method,
+            "hmatrix": { "tolerance": tol },
+            "fft": { "cells": cells }
+        },
+        "time_integration": {
+            "min(dt)": 5e-18,
+            "max(dt)": 1e-12,
+            "max(du)": 0.1
+        }
+    }
+    return settings
+
+def lastEvolLine(output_dir):
+    """ returns the last line of the .evol file as a list of floats """
+    with open(os.path.join(output_dir, "demag_benchmark.evol")) as f:
+        lines = [line for line in f if not line.startswith('#')]
+    return [float(x) for x in lines[-1].split()]
+
+def run(str_executable, settings):
+    """ feellgood executable runs in a subprocess with seed=2 for being deterministic """
+    return subprocess.run([str_executable, "--seed", "2", "-"], input=json.dumps(settings), text=True,
+                          stdout=subprocess.DEVNULL)
+
+def makeMesh(meshFileName, geometry, elt_size, surface_name, volume_name):
+    """ geometry is ('cylinder', radius, height) or ('cuboid', lx, ly, lz), sizes in nm """
+    if geometry[0] == "cylinder":
+        _, radius, height = geometry
+        Cylinder(radius, height, elt_size, surface_name, volume_name).make(meshFileName)
+    else:
+        _, lx, ly, lz = geometry
+        nb = [max(1, round(l / elt_size)) for l in (lx, ly, lz)]
+        mesh = Cuboid([0, 0, 0], [lx, ly, lz], nb[0], nb[1], nb[2])
+        mesh.make(meshFileName, volume_name, surface_name)
+
+def bench(str_executable, outputFileName, metadata, geometries, elt_size, nbThreads, final_time,
+          tol, cells):
+    """
+    for each geometry, run feellgood with the fast multipole method, the hierarchical matrix and the
+    FFT on a regular grid, write the wall times and the deviations of the final <M> and demag energy
+    versus the fast multipole method
+    """
+    surface_name = "surface"
+    volume_name = "volume"
+    methods = ["fmm", "hmatrix", "fft"]
+
+    with open(outputFileName, 'w') as f:
+        f.write(metadata)
+        f.write("# geometry\tt_fmm\tt_hmatrix\tt_fft\tmax|d<M>|_hmatrix\trel_dE_demag_hmatrix"
+                "\tmax|d<M>|_fft\trel_dE_demag_fft\n")
+        for name, geometry in geometries.items():
+            meshFileName = name + ".msh"
+            makeMesh(meshFileName, geometry, elt_size, surface_name, volume_name)
+            times = {}
+            results = {}
+            for method in methods:
+                output_dir = name + '_' + method
+                settings = makeSettings(meshFileName, surface_name, volume_name, nbThreads,
+                                        final_time, method, tol, cells, output_dir)
+                times[method] = timeit.timeit(lambda: run(str_executable, settings), number=1)
+                results[method] = lastEvolLine(output_dir)
+            line = name + ''.join("\t{:.2f}".format(times[m]) for m in methods)
+            for method in methods[1:]:
+                dM = max(abs(results["fmm"][i] - results[method][i]) for i in range(1, 4))
+                dE = abs(results["fmm"][4] - results[method][4]) / abs(results["fmm"][4])
+                line += "\t{:.2e}\t{:.2e}".format(dM, dE)
+            print(line)
+            f.write(line + '\n')
+        f.close()
+
+def get_params(default_final_time, default_tol, default_cells):
+    """ command line parser """
+    import argparse
+    description = 'feellgood demag benchmark'
+    epilogue = '''
+    compares the fast multipole method, the hierarchical matrix and the FFT on a regular grid for the demagnetizing field,
+    on a thin film, a nanowire and two cuboids
+    '''
+    parser = argparse.ArgumentParser(description=description, epilog=epilogue,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-n','--nbThreads',type=int,help='number of threads',default=os.cpu_count())
+    parser.add_argument('-t','--final_time',type=float,help='final physical simulation time in s',
+                        default=default_final_time)
+    parser.add_argument('--tol',type=float,help='tolerance of the hierarchical matrix',default=default_tol)
+    parser.add_argument('--cells',type=int,help='number of cells of the FFT grid',default=default_cells)
+    parser.add_argument('-e','--elt_size',type=float,help='mesh size in nm',default=3.0)
+    parser.add_argument('--version',action='version',version= __version__,help='show the version number')
+    return parser.parse_args()
+
+__version__ = '1.1.0'
+if __name__ == '__main__':
+    args = get_params(2e-11, 1e-5, 64)
+    # sizes in nm
+    geometries = { "thin_film": ("cylinder", 100.0, 5.0),
+                   "nanowire": ("cylinder", 10.0, 300.0),
+                   "cube": ("cuboid", 60.0, 60.0, 60.0),
+                   "platelet": ("cuboid", 120.0, 80.0, 20.0) }
+    os.chdir(sys.path[0])
+    try:
+        outputFileName = 'demag_benchmark.txt'
+        metadata = "# " + datetime.now().strftime("%d/%m/%Y %H:%M:%S")
+        metadata += "\n# nbThreads: " + str(args.nbThreads)
+        metadata += "\n# hmatrix tolerance: " + str(args.tol)
+        metadata += "\n# fft cells: " + str(args.cells) + '\n'
+        bench("../feellgood", outputFileName, metadata, geometries, args.elt_size, args.nbThreads,
+              args.final_time, args.tol, args.cells)
+    except KeyboardInterrupt:
+        print(" benchmark interrupted")
+        sys.exit()
@@ -0,0 +1,108 @@
+#include <iomanip>
+#include <iostream>
+
+#include "chronometer.h"
+#include "demagSolver.h"
+#include "fft_demag.h"
+#include "fmm_demag.h"
+#include "hmat_demag.h"
+
+std::unique_ptr<demagSolver> makeDemagSolver(Settings &settings, Mesh::mesh &msh)
+    {
+    if (settings.demagMethod == HMATRIX)
+        {
+        return std::make_unique<hmat::solver>(msh, settings.paramTetra, settings.paramFacette,
+                                              settings.hmatrixTol, settings.hmatrixEta,
+                                              settings.hmatrixLeafSize);
+        }
+    if (settings.demagMethod == FFT)
+        {
+        return std::make_unique<fft::solver>(msh, settings.paramTetra, settings.paramFacette,
+                                             settings.fftCells, settings.fftNearFieldRadius);
+        }
+    double nearFieldRadius = settings.fmmSourceCompression ? settings.fmmNearFieldRadius : 0;
+    return scal_fmm::make_fmm(settings.fmmKernel, msh, settings.paramTetra, settings.paramFacette,
+                              settings.scalfmmNbTh, nearFieldRadius, settings.getProbes(),
+                              settings.imageShells);
+    }
+
+// Relative error, in euclidian norm, of the potential phi of the nodes versus phi_ref.
+static double rel_error(Mesh::mesh const &msh, std::vector<double> const &phi_ref)
+    {
+    double num(0), den(0);
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        {
+        double phi = msh.get(i, Nodes::get_phi<Nodes::NEXT>);
+        num += Nodes::sq(phi - phi_ref[i]);
+        den += Nodes::sq(phi_ref[i]);
+        }
+    return sqrt(num / den);
+    }
+
+int demag_benchmark(Settings &settings, Mesh::mesh &msh)
+    {
+    const int nbRuns = 3;
+    if (settings.isPeriodic())
+        {
+        std::cout << "Fatal Error: the demag benchmark compares the solvers to a direct summation, "
+                     "it does not support periodic boundary conditions\n";
+        return 1;
+        }
+    const int nbSources = msh.getNbTets() * Tetra::NPI + msh.getNbFacs() * Facette::NPI;
+    std::cout << "\nDemag benchmark: " << msh.getNbNodes() << " nodes, " << nbSources
+              << " sources, " << settings.scalfmmNbTh << " threads for fmm\n";
+
+    chronometer counter(2);
+    directSolver reference(msh, settings.paramTetra, settings.paramFacette);
+    reference.calc_demag(msh);
+    std::cout << "direct summation reference computed in " << counter.millis() << "\n\n";
+    std::vector<double> phi_ref(msh.getNbNodes());
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        phi_ref[i] = msh.get(i, Nodes::get_phi<Nodes::NEXT>);
+
+    // benchmark a solver, print its setup time, mean time per call to calc_demag and error on phi
+    auto bench = [&](std::string const &name, std::function<std::unique_ptr<demagSolver>()> make)
+        {
+        counter.reset();
+        std::unique_ptr<demagSolver> solver = make();
+        double t_setup = counter.fp_elapsed();
+        for (int k = 0; k < nbRuns; k++)
+            solver->calc_demag(msh);
+        double t_call = counter.fp_elapsed() / nbRuns;
+        std::cout << "    " << std::left << std::setw(12) << name << std::right << std::scientific
+                  << std::setprecision(2) << std::setw(12) << t_setup << std::setw(12) << t_call
+                  << std::setw(12) << rel_error(msh, phi_ref) << '\n';
+        };
+
+    std::cout << "    solver             setup [s]    call [s]   error [*]\n";
+    std::cout << "    ──────────────────────────────────────────────────────\n";
+    double nearFieldRadius = settings.fmmSourceCompression ? settings.fmmNearFieldRadius : 0;
+    for (fmm_kernel k : {ROTATION, SPHERICAL, CHEBYSHEV, UNIFORM})
+        {
+        const char *name = k == ROTATION    ? scal_fmm::rotationKernel<>::name
+                           : k == SPHERICAL ? scal_fmm::sphericalKernel<>::name
+                           : k == CHEBYSHEV ? scal_fmm::chebyshevKernel<>::name
+                                            : scal_fmm::uniformKernel<>::name;
+        bench(name,
+              [&]()
+              {
+                  return scal_fmm::make_fmm(k, msh, settings.paramTetra, settings.paramFacette,
+                                            settings.scalfmmNbTh, nearFieldRadius);
+              });
+        }
+    bench("hmatrix",
+          [&]()
+          {
+              return std::make_unique<hmat::solver>(msh, settings.paramTetra, settings.paramFacette,
+                                                    settings.hmatrixTol, settings.hmatrixEta,
+                                                    settings.hmatrixLeafSize);
+          });
+    bench("fft",
+          [&]()
+          {
+              return std::make_unique<fft::solver>(msh, settings.paramTetra, settings.paramFacette,
+                                                   settings.fftCells, settings.fftNearFieldRadius);
+          });
+    std::cout << "\n    [*] relative error on phi versus direct summation\n";
+    return 0;
+    }
@@ -0,0 +1,195 @@
+#ifndef demagSolver_h
+#define demagSolver_h
+
+/** \file demagSolver.h
+\brief abstract interface to the demagnetizing field solvers. The magnetic charges are computed on
+the Gauss points of the tetrahedrons and facettes, a derived class computes the scalar potentials on
+the nodes from these charges.
+*/
+
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "mesh.h"
+
+/** \class demagSolver
+base class of the demag backends. It owns the charges (sources) and the analytical corrections of
+the facettes; derived classes only have to define how the far field is summed up in member demag.
+Sources are numbered the same way by all backends: Gauss points of the tetrahedrons first, then
+Gauss points of the facettes.
+*/
+class demagSolver
+    {
+public:
+    /** constructor, initialize memory for sources and corrections */
+    demagSolver(Mesh::mesh &msh /**< [in] */,
+                std::vector<Tetra::prm> &prmTet /**< [in] */,
+                std::vector<Facette::prm> &prmFac /**< [in] */)
+        : prmTetra(prmTet), prmFacette(prmFac), NOD(msh.getNbNodes())
+        {
+        srcDen.resize(msh.getNbFacs() * Facette::NPI + msh.getNbTets() * Tetra::NPI);
+        corr.resize(NOD);
+        }
+
+    /** destructor */
+    virtual ~demagSolver() {}
+
+    /**
+    launch the calculation of the demag field with second order corrections
+    */
+    void calc_demag(Mesh::mesh &msh /**< [in] */)
+        {
+        demag(Nodes::get_u<Nodes::NEXT>, Nodes::set_phi, msh);
+        updateProbes();
+        demag(Nodes::get_v<Nodes::NEXT>, Nodes::set_phiv, msh);
+        }
+
+    /** launch the calculation of the demag potential of the magnetization only, when the potential
+     * of the speed is not needed */
+    void calc_phi(Mesh::mesh &msh /**< [in] */)
+        {
+        demag(Nodes::get_u<Nodes::NEXT>, Nodes::set_phi, msh);
+        updateProbes();
+        }
+
+    /** print some informations on the solver */
+    virtual void infos(void) const {}
+
+    /** sources */
+    std::vector<double> srcDen;
+
+    /** corrections associated to the nodes, contributions only due to the facettes */
+    std::vector<double> corr;
+
+    /** all volume region parameters for the tetraedrons */
+    std::vector<Tetra::prm> prmTetra;
+
+    /** all surface region parameters for the facettes */
+    std::vector<Facette::prm> prmFacette;
+
+    /** demag potential on the probes, from the last call to calc_demag, empty if the solver has no
+     * probes */
+    std::vector<double> probePhi;
+
+    /** demag field on the probes, from the last call to calc_demag */
+    std::vector<Eigen::Vector3d> probeH;
+
+protected:
+    const int NOD; /**< number of nodes */
+
+    /** computes all charges from tetraedrons and facettes, and the corrections of the facettes
+     */
+    void calc_charges(std::function<const Eigen::Vector3d(Nodes::Node)> getter, Mesh::mesh &msh)
+        {
+        int nsrc(0);
+        std::fill(srcDen.begin(), srcDen.end(), 0);
+
+        std::for_each(msh.tet.begin(), msh.tet.end(),
+                      [this, getter, &nsrc](Tetra::Tet const &tet)
+                          { tet.charges(prmTetra[tet.idxPrm], getter, srcDen, nsrc); });
+        std::fill(corr.begin(), corr.end(), 0);
+        std::for_each(msh.fac.begin(), msh.fac.end(),
+                      [this, getter, &nsrc](Facette::Fac const &fac)
+                          { fac.charges(prmFacette[fac.idxPrm], getter, srcDen, nsrc, corr); });
+        }
+
+    /** \return positions of the sources, in the same order as srcDen */
+    static std::vector<Eigen::Vector3d> sourcePositions(Mesh::mesh const &msh /**< [in] */)
+        {
+        std::vector<Eigen::Vector3d> pts;
+        pts.reserve(msh.getNbTets() * Tetra::NPI + msh.getNbFacs() * Facette::NPI);
+        for (Tetra::Tet const &tet : msh.tet)
+            {
+            Eigen::Matrix<double, Nodes::DIM, Tetra::NPI> gauss;
+            tet.getPtGauss(gauss);
+            for (int j = 0; j < Tetra::NPI; j++)
+                pts.push_back(gauss.col(j));
+            }
+        for (Facette::Fac const &fac : msh.fac)
+            {
+            Eigen::Matrix<double, Nodes::DIM, Facette::NPI> gauss;
+            fac.getPtGauss(gauss);
+            for (int j = 0; j < Facette::NPI; j++)
+                pts.push_back(gauss.col(j));
+            }
+        return pts;
+        }
+
+    /** \return positions of the nodes */
+    static std::vector<Eigen::Vector3d> nodePositions(Mesh::mesh const &msh /**< [in] */)
+        {
+        std::vector<Eigen::Vector3d> pts(msh.getNbNodes());
+        for (int i = 0; i < msh.getNbNodes(); i++)
+            pts[i] = msh.getNode_p(i);
+        return pts;
+        }
+
+    /**
+    computes the demag field, with (getter  = u,setter = phi) or (getter = v,setter = phi_v)
+    */
+    virtual void demag(std::function<const Eigen::Vector3d(Nodes::Node)> getter,
+                       std::function<void(Nodes::Node &, const double)> setter,
+                       Mesh::mesh &msh) = 0;
+
+    /** computes probePhi and probeH, called right after the computation of phi */
+    virtual void updateProbes(void) {}
+    };
+
+/** \class directSolver
+reference demag solver: the potentials are computed by direct summation over all the sources, in
+O(number of nodes x number of sources). It is meant for tests and benchmarks.
+*/
+class directSolver : public demagSolver
+    {
+public:
+    /** constructor */
+    directSolver(Mesh::mesh &msh /**< [in] */,
+                 std::vector<Tetra::prm> &prmTet /**< [in] */,
+                 std::vector<Facette::prm> &prmFac /**< [in] */)
+        : demagSolver(msh, prmTet, prmFac), src(sourcePositions(msh)), idx(NOD), pot(NOD)
+        {
+        std::iota(idx.begin(), idx.end(), 0);
+        }
+
+private:
+    std::vector<Eigen::Vector3d> src; /**< positions of the sources */
+    std::vector<int> idx;             /**< node indices */
+    std::vector<double> pot;          /**< potentials, without corrections */
+
+    /**
+    computes the demag field, with (getter  = u,setter = phi) or (getter = v,setter = phi_v)
+    */
+    void demag(std::function<const Eigen::Vector3d(Nodes::Node)> getter,
+               std::function<void(Nodes::Node &, const double)> setter, Mesh::mesh &msh) override
+        {
+        calc_charges(getter, msh);
+        std::for_each(EXEC_POL, idx.begin(), idx.end(),
+                      [this, &msh](const int i)
+                      {
+                          const Eigen::Vector3d p = msh.getNode_p(i);
+                          double val(0);
+                          for (unsigned int j = 0; j < src.size(); j++)
+                              val += srcDen[j] / (p - src[j]).norm();
+                          pot[i] = val;
+                      });
+        for (int i = 0; i < NOD; i++)
+            {
+            msh.set(i, setter, (pot[i] + corr[i]) / (4 * M_PI));
+            }
+        }
+    };
+
+/** \return the demag solver selected in section demagnetizing_field_solver of the settings */
+std::unique_ptr<demagSolver> makeDemagSolver(Settings &settings /**< [in] */,
+                                             Mesh::mesh &msh /**< [in] */);
+
+/**
+run all demag solvers (every fmm kernel, the hierarchical matrix and the FFT solver) on the mesh, print their setup
+time, their time per call to calc_demag and their error against directSolver
+\return 0
+*/
+int demag_benchmark(Settings &settings /**< [in] */, Mesh::mesh &msh /**< [in] */);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+  Dimer method: minimum mode following from a single state of the magnetization, up to a first
+  order saddle point of the energy. The lowest curvature mode is estimated by finite differences of
+  the effective field between the two ends of the dimer, so an iteration costs two evaluations of
+  the effective field.
+ */
+
+#include <random>
+#include <signal.h>
+
+#include "demagSolver.h"
+#include "fem.h"
+#include "time_integration.h"
+
+/** force \f$ \mu_0 (H - (H \cdot u) u) \f$ on the nodes of the configuration u, zero on the frozen
+ * nodes, and its energy */
+static double tangentForce(Fem &fem, Settings &settings, demagSolver &demagSol, const double t,
+                           std::vector<bool> const &frozen, std::vector<Eigen::Vector3d> const &u,
+                           std::vector<Eigen::Vector3d> &F)
+    {
+    const int NOD = fem.msh.getNbNodes();
+    std::vector<Eigen::Vector3d> H;
+    for (int i = 0; i < NOD; i++)
+        fem.msh.setNode_u(i, u[i]);
+    demagSol.calc_phi(fem.msh);
+    fem.effectiveField(t, settings, H);
+    F.resize(NOD);
+    for (int i = 0; i < NOD; i++)
+        F[i] = frozen[i] ? Eigen::Vector3d::Zero()
+                         : Eigen::Vector3d(mu0 * (H[i] - H[i].dot(u[i]) * u[i]));
+    fem.energy(t, settings);
+    return fem.Etot;
+    }
+
+/** projects the vector field N on the tangent planes of u, zero on the frozen nodes, and
+ * normalizes it */
+static void project(std::vector<bool> const &frozen, std::vector<Eigen::Vector3d> const &u,
+                    std::vector<Eigen::Vector3d> &N)
+    {
+    double norm2(0);
+    for (unsigned int i = 0; i < N.size(); i++)
+        {
+        if (frozen[i]) N[i].setZero();
+        N[i] -= N[i].dot(u[i]) * u[i];
+        norm2 += N[i].squaredNorm();
+        }
+    for (unsigned int i = 0; i < N.size(); i++)
+        N[i] /= sqrt(norm2);
+    }
+
+int dimer(Fem &fem, Settings &settings, demagSolver &demagSol, timing const &t_prm, int &nt)
+    {
+    const double max_angle = 0.2;  // largest rotation of a node in one iteration
+    const double t = t_prm.get_t();
+    const double L = settings.dimerLength;
+    const int NOD = fem.msh.getNbNodes();
+    const std::vector<bool> frozen = fem.msh.frozenNodes(settings.paramTetra);
+
+    std::vector<Eigen::Vector3d> u(NOD), u1(NOD), F(NOD), F1(NOD), N(NOD);
+    for (int i = 0; i < NOD; i++)
+        u[i] = fem.msh.getNode_u(i);
+
+    // random initial direction, the same on a node and its periodic images
+    std::mt19937 gen(settings.drawSeed());
+    std::normal_distribution<> distrib(0.0, 1.0);
+    for (int i = 0; i < NOD; i++)
+        if (fem.msh.getMaster(i) == i)
+            N[i] = Eigen::Vector3d(distrib(gen), distrib(gen), distrib(gen));
+    for (int i = 0; i < NOD; i++)
+        N[i] = N[fem.msh.getMaster(i)];
+    project(frozen, u, N);
+
+    std::string baseName = settings.r_path_output_dir + '/' + settings.getSimName();
+    std::string str = baseName + "_dimer.evol";
+    std::ofstream fout(str);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    fout << settings.columnsMetadata("iter\tE\tmax(force)\tcurvature\trotation\tmax(du)");
+    fout.precision(16);
+
+    std::cout << "Dimer saddle point search: max(force) = " << settings.dimerMaxForce << " T\n";
+    double E(0), C(0), F_max(0);
+    int status(1);
+    for (nt = 0; nt < settings.dimerMaxIter; nt++)
+        {
+        extern volatile sig_atomic_t received_signal;  // set by signal_handler() in main.cpp
+        if (received_signal)
+            {
+            std::cout << "\nReceived signal: stopping the saddle point search.\n";
+            break;
+            }
+
+        // forces at both ends of the dimer, the one at the far end brought back on the tangent
+        // planes of the center
+        E = tangentForce(fem, settings, demagSol, t, frozen, u, F);
+        for (int i = 0; i < NOD; i++)
+            u1[i] = (u[i] + L * N[i]).normalized();
+        tangentForce(fem, settings, demagSol, t, frozen, u1, F1);
+        double dFN(0);
+        for (int i = 0; i < NOD; i++)
+            {
+            F1[i] -= F1[i].dot(u[i]) * u[i];
+            F1[i] -= F[i];
+            dFN += F1[i].dot(N[i]);
+            }
+        C = -dFN / L;
+
+        // rotation of the dimer toward the lowest curvature mode, in the plane of N and of the
+        // rotational force
+        F_max = 0;
+        double Frot2(0);
+        for (int i = 0; i < NOD; i++)
+            {
+            F1[i] -= dFN * N[i];
+            Frot2 += F1[i].squaredNorm();
+            F_max = std::max(F_max, F[i].norm());
+            }
+        const double Frot = sqrt(Frot2);
+        const double theta = 0.5 * atan2(Frot / L, fabs(C));
+        if (Frot > 0)
+            for (int i = 0; i < NOD; i++)
+                N[i] = cos(theta) * N[i] + sin(theta) * F1[i] / Frot;
+
+        if (settings.verbose)
+            std::cout << "iter " << nt << ": E = " << E << ", max(force) = " << F_max
+                      << " T, curvature = " << C << ", rotation = " << theta << std::endl;
+        if (F_max < settings.dimerMaxForce && C < 0)
+            {
+            fout << nt << '\t' << E << '\t' << F_max << '\t' << C << '\t' << theta << "\t0\n";
+            status = 0;
+            break;
+            }
+
+        // translation: the force along the mode is reversed on a negative curvature, only its
+        // reverse is kept on a positive curvature, to leave the basin
+        double FN(0);
+        for (int i = 0; i < NOD; i++)
+            FN += F[i].dot(N[i]);
+        for (int i = 0; i < NOD; i++)
+            F[i] = (C < 0) ? Eigen::Vector3d(F[i] - 2 * FN * N[i]) : Eigen::Vector3d(-FN * N[i]);
+        double v_max(0);
+        for (int i = 0; i < NOD; i++)
+            v_max = std::max(v_max, F[i].norm());
+        const double step = std::min(settings.dimerStep, max_angle / std::max(v_max, 1e-300));
+        double du_max(0);
+        for (int i = 0; i < NOD; i++)
+            {
+            Eigen::Vector3d u_new = (u[i] + step * F[i]).normalized();
+            du_max = std::max(du_max, (u_new - u[i]).norm());
+            u[i] = u_new;
+            }
+        project(frozen, u, N);
+        fout << nt << '\t' << E << '\t' << F_max << '\t' << C << '\t' << theta << '\t' << du_max
+             << std::endl;
+        }
+    fout.close();
+
+    if (status == 0)
+        std::cout << "converged in " << nt << " iterations";
+    else
+        std::cout << "not converged after " << nt << " iterations";
+    std::cout << ": E = " << E << ", max(force) = " << F_max << " T, curvature = " << C << "\n";
+
+    for (int i = 0; i < NOD; i++)
+        fem.msh.setNode_u(i, u[i]);
+    demagSol.calc_phi(fem.msh);
+    std::string fileName = baseName + "_saddle.sol";
+    std::string metadata = settings.solMetadata(t, "idx\tmx\tmy\tmz\tphi");
+    fem.msh.savesol(settings.getPrecision(), fileName, metadata);
+    std::cout << "Magnetization configuration saved to " << fileName << "\n";
+    return status;
+    }
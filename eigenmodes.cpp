@@ -0,0 +1,320 @@
+/**
+  Spin wave eigenmodes: the LLG equation without damping, linearized around an equilibrium in the
+  tangent basis (ep, eq) of the nodes, and its modes of lowest frequency by shift-invert Arnoldi
+  iteration. The linearized effective field is computed by finite differences of the effective
+  field, demagnetizing field included, so no matrix is assembled.
+ */
+
+#include <complex>
+#include <random>
+#include <signal.h>
+
+#include "demagSolver.h"
+#include "fem.h"
+#include "time_integration.h"
+
+/** \return the degree of freedom of each node in the linearization, -1 for the frozen nodes: the
+ * degrees of freedom of the mesh, without the frozen ones */
+static std::vector<int> linearDofs(Mesh::mesh const &msh, std::vector<Tetra::prm> const &prmTet)
+    {
+    const std::vector<bool> frozen = msh.frozenNodes(prmTet);
+    std::vector<int> renum(msh.getNbDofs(), -1);
+    int n(0);
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        if (msh.getMaster(i) == i && !frozen[i]) renum[msh.getDof(i)] = n++;
+    std::vector<int> dof(msh.getNbNodes());
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        dof[i] = renum[msh.getDof(i)];
+    return dof;
+    }
+
+/** Linearization of the LLG equation around the equilibrium u0. A small deviation of the
+ * magnetization is a vector x of 2*NDOF coordinates: the components along ep on the degrees of
+ * freedom that are not frozen, then the ones along eq. The Hessian of the energy A is symmetric for the inner product
+ * weighted by the magnetic moments of the nodes, and the linearized equation is
+ * \f$ dx/dt = \gamma_0 J A x \f$ with J the rotation by \f$ \pi/2 \f$ around u0. */
+class Linearization
+    {
+public:
+    /** stores the equilibrium, its tangent basis, its effective field and the moments of the degrees
+     * of freedom */
+    Linearization(Fem &_fem, Settings &_settings, demagSolver &_demagSol, const double _t)
+        : fem(_fem), settings(_settings), demagSol(_demagSol), t(_t),
+          NOD(_fem.msh.getNbNodes()), dof(linearDofs(_fem.msh, _settings.paramTetra)),
+          NDOF(1 + *std::max_element(dof.begin(), dof.end())), u0(NOD), ep(NOD), eq(NOD), h0(NOD)
+        {
+        for (int i = 0; i < NOD; i++)
+            {
+            u0[i] = fem.msh.getNode_u(i);
+            fem.msh.set_node_u0(i, u0[i]);
+            }
+        fem.msh.setBasis(0);
+        for (int i = 0; i < NOD; i++)
+            {
+            ep[i] = fem.msh.getNode_ep(i);
+            eq[i] = fem.msh.getNode_eq(i);
+            }
+        demagSol.calc_phi(fem.msh);
+        fem.effectiveField(t, settings, H0);
+        torque = 0;
+        for (int i = 0; i < NOD; i++)
+            {
+            h0[i] = H0[i].dot(u0[i]);
+            if (dof[i] >= 0) torque = std::max(torque, mu0 * u0[i].cross(H0[i]).norm());
+            }
+
+        // same moments as the ones normalizing the effective field
+        W = Eigen::VectorXd::Zero(2 * NDOF);
+        for (Tetra::Tet const &te : fem.msh.tet)
+            {
+            Eigen::Matrix<double,Tetra::N,1> m =
+                    settings.paramTetra[te.idxPrm].J * (Tetra::eigen_a * te.weight);
+            for (int i = 0; i < Tetra::N; i++)
+                if (dof[te.ind[i]] >= 0) W(dof[te.ind[i]]) += m(i);
+            }
+        W.tail(NDOF) = W.head(NDOF);
+        }
+
+    /** puts the equilibrium back in the mesh */
+    ~Linearization()
+        {
+        for (int i = 0; i < NOD; i++)
+            fem.msh.setNode_u(i, u0[i]);
+        demagSol.calc_phi(fem.msh);
+        }
+
+    /** \return the inner product weighted by the moments */
+    inline double dot(Eigen::Ref<const Eigen::VectorXd> x, Eigen::Ref<const Eigen::VectorXd> y) const
+        {
+        return x.dot(W.cwiseProduct(y));
+        }
+
+    /** \return the deviation of node i for the coordinates x, zero on a frozen node */
+    template <typename Vector>
+    inline Eigen::Matrix<typename Vector::Scalar, Nodes::DIM, 1> deviation(Vector const &x,
+                                                                          const int i) const
+        {
+        const int d = dof[i];
+        if (d < 0) return Eigen::Matrix<typename Vector::Scalar, Nodes::DIM, 1>::Zero();
+        return x(d) * ep[i] + x(NDOF + d) * eq[i];
+        }
+
+    /** y = A x: the effective field is affine in the magnetization for the exchange, the uniaxial
+     * anisotropy and the demagnetizing field, so a single finite difference is exact for them */
+    void hessian(Eigen::Ref<const Eigen::VectorXd> x, Eigen::Ref<Eigen::VectorXd> y)
+        {
+        const double eps = 1e-4 / std::max(x.cwiseAbs().maxCoeff(), 1e-300);
+        for (int i = 0; i < NOD; i++)
+            fem.msh.setNode_u(i, u0[i] + eps * deviation(x, i));
+        demagSol.calc_phi(fem.msh);
+        fem.effectiveField(t, settings, H);
+        for (int i = 0; i < NOD; i++)
+            if (fem.msh.getMaster(i) == i && dof[i] >= 0)
+                {
+                const int d = dof[i];
+                Eigen::Vector3d r = h0[i] * deviation(x, i) - (H[i] - H0[i]) / eps;
+                y(d) = r.dot(ep[i]);
+                y(NDOF + d) = r.dot(eq[i]);
+                }
+        nb_hessian++;
+        }
+
+    /** solves A y = b by conjugate gradients, \return false if A is not positive definite or if the
+     * solver did not converge */
+    bool solve(Eigen::Ref<const Eigen::VectorXd> b, Eigen::Ref<Eigen::VectorXd> y)
+        {
+        Eigen::VectorXd r = b, p = b, Ap(2 * NDOF);
+        y.setZero();
+        double rr = dot(r, r);
+        const double stop = Nodes::sq(settings.eigTol) * rr;
+        for (int k = 0; k < settings.eigMaxIter; k++)
+            {
+            if (rr <= stop) return true;
+            hessian(p, Ap);
+            const double pAp = dot(p, Ap);
+            if (pAp <= 0)
+                {
+                std::cout << "the Hessian of the energy is not positive definite: the initial "
+                             "magnetization is not a stable equilibrium.\n";
+                return false;
+                }
+            const double a = rr / pAp;
+            y += a * p;
+            r -= a * Ap;
+            const double rr_new = dot(r, r);
+            p = r + (rr_new / rr) * p;
+            rr = rr_new;
+            }
+        if (rr <= stop) return true;
+        std::cout << "conjugate gradients not converged after " << settings.eigMaxIter
+                  << " iterations.\n";
+        return false;
+        }
+
+    /** y = (gamma0 J A)^-1 z, \return false if the linear solve failed */
+    bool inverse(Eigen::Ref<const Eigen::VectorXd> z, Eigen::Ref<Eigen::VectorXd> y)
+        {
+        Eigen::VectorXd b(2 * NDOF);
+        b.head(NDOF) = z.tail(NDOF) / gamma0;
+        b.tail(NDOF) = -z.head(NDOF) / gamma0;
+        return solve(b, y);
+        }
+
+    Fem &fem;                   /**< finite element problem */
+    Settings &settings;         /**< settings */
+    demagSolver &demagSol;      /**< demagnetizing field solver */
+    const double t;             /**< time of the applied field */
+    const int NOD;              /**< number of nodes */
+    const std::vector<int> dof; /**< degree of freedom of each node, -1 for a frozen node */
+    const int NDOF;             /**< number of degrees of freedom, without the frozen nodes */
+    std::vector<Eigen::Vector3d> u0;  /**< equilibrium magnetization */
+    std::vector<Eigen::Vector3d> ep;  /**< first vector of the tangent basis */
+    std::vector<Eigen::Vector3d> eq;  /**< second vector of the tangent basis, u0 x ep */
+    std::vector<Eigen::Vector3d> H0;  /**< effective field at equilibrium */
+    std::vector<Eigen::Vector3d> H;   /**< effective field, work space */
+    std::vector<double> h0;     /**< component of H0 along u0 */
+    Eigen::VectorXd W;          /**< magnetic moments of the degrees of freedom */
+    double torque;              /**< maximum torque at equilibrium, in tesla */
+    int nb_hessian = 0;         /**< number of products by the Hessian */
+    };
+
+int eigenmodes(Fem &fem, Settings &settings, demagSolver &demagSol, timing const &t_prm, int &nt)
+    {
+    Linearization lin(fem, settings, demagSol, t_prm.get_t());
+    if (lin.NDOF == 0)
+        {
+        std::cout << "all the nodes are frozen: no eigenmode.\n";
+        return 1;
+        }
+    const int n = 2 * lin.NDOF;
+    const int m = std::min(settings.eigKrylovDim, n);
+    std::cout << "Eigenmodes: " << settings.eigCount << " modes, Krylov dimension " << m
+              << ", max(torque) of the initial magnetization = " << lin.torque << " T\n";
+
+    // Arnoldi iteration on (gamma0 J A)^-1, orthonormal basis V for the weighted inner product,
+    // from a random vector (see the --seed option)
+    Eigen::MatrixXd V(n, m + 1);
+    Eigen::MatrixXd Hm = Eigen::MatrixXd::Zero(m + 1, m);
+    std::mt19937 gen(settings.drawSeed());
+    std::normal_distribution<> distrib(0.0, 1.0);
+    for (int k = 0; k < n; k++)
+        V(k, 0) = distrib(gen);
+    V.col(0) /= sqrt(lin.dot(V.col(0), V.col(0)));
+    int status(0);
+    int j;
+    for (j = 0; j < m; j++)
+        {
+        extern volatile sig_atomic_t received_signal;  // set by signal_handler() in main.cpp
+        if (received_signal)
+            {
+            std::cout << "\nReceived signal: stopping the Arnoldi iteration.\n";
+            status = 1;
+            break;
+            }
+        if (!lin.inverse(V.col(j), V.col(j + 1)))
+            {
+            status = 1;
+            break;
+            }
+        for (int pass = 0; pass < 2; pass++)  // Gram-Schmidt, twice is enough
+            for (int i = 0; i <= j; i++)
+                {
+                const double h = lin.dot(V.col(i), V.col(j + 1));
+                Hm(i, j) += h;
+                V.col(j + 1) -= h * V.col(i);
+                }
+        Hm(j + 1, j) = sqrt(lin.dot(V.col(j + 1), V.col(j + 1)));
+        if (settings.verbose)
+            std::cout << "Arnoldi step " << j << ": " << lin.nb_hessian
+                      << " products by the Hessian so far" << std::endl;
+        if (Hm(j + 1, j) < 1e-14 * Hm.col(j).norm())
+            {
+            j++;  // invariant subspace: the Ritz pairs are exact
+            break;
+            }
+        V.col(j + 1) /= Hm(j + 1, j);
+        }
+    nt = lin.nb_hessian;
+    if (status != 0) return status;
+
+    // Ritz pairs: the eigenvalues of gamma0 J A are i omega, those of its inverse -i / omega
+    Eigen::EigenSolver<Eigen::MatrixXd> es(Hm.topLeftCorner(j, j));
+    struct Mode
+        {
+        double omega;     /**< angular frequency */
+        double residual;  /**< relative residual of the eigenpair */
+        Eigen::VectorXcd s;  /**< coordinates in the Krylov basis */
+        };
+    std::vector<Mode> modes;
+    for (int k = 0; k < j; k++)
+        {
+        const std::complex<double> theta = es.eigenvalues()(k);
+        const double omega = std::imag(1.0 / theta);
+        if (omega <= 0) continue;
+        Eigen::VectorXcd s = es.eigenvectors().col(k);
+        s /= s.norm();
+        const double residual = (j < m) ? 0 : Hm(j, j - 1) * std::abs(s(j - 1)) / std::abs(theta);
+        modes.push_back({omega, residual, s});
+        }
+    std::sort(modes.begin(), modes.end(),
+              [](Mode const &a, Mode const &b) { return a.omega < b.omega; });
+    if (static_cast<int>(modes.size()) > settings.eigCount) modes.resize(settings.eigCount);
+
+    std::string baseName = settings.r_path_output_dir + '/' + settings.getSimName();
+    std::string str = baseName + "_eigenmodes.evol";
+    std::ofstream fout(str);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    fout << settings.columnsMetadata("mode\tf\tomega\tresidual");
+    fout.precision(16);
+
+    std::string metadata = settings.solMetadata(t_prm.get_t(),
+                                                "idx\tRe(mx)\tRe(my)\tRe(mz)\tIm(mx)\tIm(my)\tIm(mz)");
+    std::vector<Eigen::Vector3d> re(lin.NOD), im(lin.NOD);
+    for (unsigned int k = 0; k < modes.size(); k++)
+        {
+        Mode const &mode = modes[k];
+        if (mode.residual > settings.eigTol) status = 1;
+        fout << k << '\t' << mode.omega / (2 * M_PI) << '\t' << mode.omega << '\t' << mode.residual
+             << '\n';
+        std::cout << "mode " << k << ": f = " << mode.omega / (2 * M_PI) << " Hz, residual "
+                  << mode.residual << "\n";
+
+        // profile normalized to a maximum of 1, with a real largest component
+        Eigen::VectorXcd x = V.leftCols(j).cast<std::complex<double>>() * mode.s;
+        std::vector<Eigen::Vector3cd> du(lin.NOD);
+        double du_max(0);
+        std::complex<double> phase(1);
+        for (int i = 0; i < lin.NOD; i++)
+            {
+            du[i] = lin.deviation(x, i);
+            Eigen::Index c;
+            const double a = du[i].cwiseAbs().maxCoeff(&c);
+            if (a > du_max)
+                {
+                du_max = a;
+                phase = du[i](c) / a;
+                }
+            }
+        for (int i = 0; i < lin.NOD; i++)
+            {
+            du[i] /= phase * du_max;
+            re[i] = du[i].real();
+            im[i] = du[i].imag();
+            }
+        fem.msh.savesol(settings.getPrecision(), baseName + "_mode" + std::to_string(k) + ".sol",
+                        metadata, re, im);
+        }
+    fout.close();
+    if (static_cast<int>(modes.size()) < settings.eigCount)
+        {
+        std::cout << "only " << modes.size() << " modes found, increase krylov_dimension.\n";
+        status = 1;
+        }
+    std::cout << lin.nb_hessian << " products by the Hessian\n";
+    std::cout << "Frequencies saved to " << str << ", modes to " << baseName << "_mode<k>.sol\n";
+    return status;
+    }
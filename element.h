@@ -83,17 +83,21 @@ with each block E(p|q)(x|y|z) a N*N diagonal matrix
         P.template block<N,N>(N,2*N).diagonal() = tempo.row(Nodes::IDX_Z);
         }
 
-    /** assemble the big sparse matrix K from tetra or facette inner matrix Kp */
-    void assemblage_mat(const int NOD /**< [in] nb nodes */,
+    /** assemble the big sparse matrix K from tetra or facette inner matrix Kp, the rows and columns
+     * are the degrees of freedom dof[ind[i]] of the nodes, the nodes of negative dof are skipped */
+    void assemblage_mat(std::vector<int> const &dof /**< [in] degree of freedom of the nodes */,
+                        const int NOD /**< [in] nb degrees of freedom */,
                         std::vector<Eigen::Triplet<double>> &K /**< [out] COO matrix */ ) const
         {
         for (int i = 0; i < N; i++)
             {
-            int i_ = ind[i];
+            int i_ = dof[ind[i]];
+            if (i_ < 0) continue;
 
             for (int j = 0; j < N; j++)
                 {
-                int j_ = ind[j];
+                int j_ = dof[ind[j]];
+                if (j_ < 0) continue;  // the speed of a frozen node is zero
                 if(Kp(i,j) != 0) K.emplace_back( NOD + i_, j_, Kp(i,j) );
                 if (Kp(i,N + j) != 0) K.emplace_back( NOD + i_, NOD + j_, Kp(i,N + j) );
                 if (Kp(N + i,j) != 0) K.emplace_back( i_, j_, Kp(N + i,j) );
@@ -103,12 +107,14 @@ with each block E(p|q)(x|y|z) a N*N diagonal matrix
         }
 
     /** assemble the big vector L from tetra or facette inner vector Lp */
-    void assemblage_vect(const int NOD /**< [in] nb nodes */,
-                        Eigen::Ref<Eigen::VectorXd> L /**< [out] vector */) const
+    void assemblage_vect(std::vector<int> const &dof /**< [in] degree of freedom of the nodes */,
+                         const int NOD /**< [in] nb degrees of freedom */,
+                         Eigen::Ref<Eigen::VectorXd> L /**< [out] vector */) const
         {
         for (int i = 0; i < N; i++)
             {
-            const int i_ = ind[i];
+            const int i_ = dof[ind[i]];
+            if (i_ < 0) continue;
             if(Lp[i] != 0)
                 { L(NOD + i_) += Lp[i]; }
             if(Lp[N+i] != 0)
@@ -46,3 +46,53 @@ void Fem::energy(double const t, Settings &settings)
     if (settings.verbose && (Etot > Etot0))
         { std::cout << "WARNING: energy increased from " << Etot0 << " to " << Etot << "\n"; }
     }
+
+void Fem::effectiveField(double const t, Settings &settings, std::vector<Eigen::Vector3d> &H) const
+    {
+    const int NOD = msh.getNbNodes();
+    std::vector<Eigen::Vector3d> G(NOD, Eigen::Vector3d::Zero());
+    std::vector<double> moment(NOD, 0);
+    Eigen::Vector3d Hext = settings.getField(t);
+
+    std::for_each(msh.tet.begin(), msh.tet.end(),
+                  [&G, &moment, &Hext, &settings](Tetra::Tet const &te)
+                  {
+                      Tetra::prm const &param = settings.paramTetra[te.idxPrm];
+                      Eigen::Matrix<double,Nodes::DIM,Tetra::N> g;
+                      g.setZero();
+                      te.energyGradient(param, Hext, g);
+                      Eigen::Matrix<double,Tetra::N,1> m = param.J * (Tetra::eigen_a * te.weight);
+                      for (int i = 0; i < Tetra::N; i++)
+                          {
+                          G[te.ind[i]] += g.col(i);
+                          moment[te.ind[i]] += m(i);
+                          }
+                  });
+
+    std::for_each(msh.fac.begin(), msh.fac.end(),
+                  [&G, &settings](Facette::Fac const &fa)
+                  {
+                      Eigen::Matrix<double,Nodes::DIM,Facette::N> g;
+                      g.setZero();
+                      fa.energyGradient(settings.paramFacette[fa.idxPrm], g);
+                      for (int i = 0; i < Facette::N; i++)
+                          { G[fa.ind[i]] += g.col(i); }
+                  });
+
+    // a node and its periodic images are the same point
+    for (int i = 0; i < NOD; i++)
+        {
+        const int m = msh.getMaster(i);
+        if (m != i)
+            {
+            G[m] += G[i];
+            moment[m] += moment[i];
+            }
+        }
+    H.resize(NOD);
+    for (int i = 0; i < NOD; i++)
+        {
+        const int m = msh.getMaster(i);
+        H[i] = G[m] / moment[m];
+        }
+    }
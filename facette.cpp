@@ -85,6 +85,23 @@ double Fac::demagEnergy(Eigen::Ref<Eigen::Matrix<double,DIM,NPI>> u, Eigen::Ref<
     return 0.5*mu0*dMs*dens.dot(weight);
     }
 
+void Fac::energyGradient(Facette::prm const &param, Eigen::Ref<Eigen::Matrix<double,DIM,N>> G) const
+    {
+    Eigen::Matrix<double,DIM,NPI> u;
+    interpolation(Nodes::get_u<NEXT>, u);
+    Eigen::Matrix<double,NPI,1> phi;
+    interpolation(Nodes::get_phi<NEXT>, phi);
+
+    for (int npi = 0; npi < NPI; npi++)
+        {
+        Eigen::Vector3d H = 2.0*param.Ks*param.uk.dot(u.col(npi))*param.uk;
+        if (!param.suppress_charges)
+            { H -= mu0*dMs*phi[npi]*n; }
+        for (int i = 0; i < N; i++)
+            { G.col(i) += weight[npi]*a[i][npi]*H; }
+        }
+    }
+
 double Fac::potential(std::function<Eigen::Vector3d(Nodes::Node)> getter, int i) const
     {
     int ii = (i + 1) % 3;
@@ -142,6 +142,11 @@ public:
     double demagEnergy(Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,NPI>> u /**< [in] */,
                        Eigen::Ref<Eigen::Matrix<double,NPI,1>> phi /**< [in] */) const;
 
+    /** adds to G the opposite of the gradient of the surface anisotropy and demag energies of the
+     * facette with respect to the magnetization of its nodes, on the NEXT step */
+    void energyGradient(Facette::prm const &param /**< [in] */,
+                        Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,N>> G /**< [in|out] */) const;
+
     /** computes correction on potential*/
     double potential(std::function<Eigen::Vector3d(Nodes::Node)> getter, int i) const;
 
@@ -64,6 +64,18 @@ static bool assign(Eigen::Vector3d &var, const YAML::Node &node)
     return false;
     }
 
+// Conditionally assign a point (not normalized) if the node is defined.
+static bool assign_point(Eigen::Vector3d &var, const YAML::Node &node)
+    {
+    if (node && !node.IsNull())
+        {
+        if (!node.IsSequence() || node.size() != 3) error("points should be sequences of three numbers.");
+        var = { node[0].as<double>(), node[1].as<double>(), node[2].as<double>() };
+        return true;
+        }
+    return false;
+    }
+
 // Replace, within `s', all occurrences of `search' by `replacement'.
 static void replace(std::string &s, const std::string &search, const std::string &replacement)
     {
@@ -143,6 +155,7 @@ void Settings::toYaml()
     std::cout << "  file_basename: " << simName << "\n";
     std::cout << "  evol_time_step: " << time_step << "\n";
     std::cout << "  final_time: " << tf << "\n";
+    std::cout << "  dense_output: " << str(denseOutput) << "\n";
     std::cout << "  evol_columns:\n";
     for (auto it = evol_columns.begin(); it != evol_columns.end(); ++it)
         {
@@ -175,6 +188,7 @@ void Settings::toYaml()
             std::cout << "      ez: " << str(it->ez) << "\n";
             }
         std::cout << "      alpha_LLG: " << it->alpha_LLG << "\n";
+        std::cout << "      frozen: " << str(it->frozen) << "\n";
         }
     std::cout << "  surface_regions:\n";
     for (auto it = paramFacette.begin(); it != paramFacette.end(); ++it)
@@ -186,18 +200,32 @@ void Settings::toYaml()
         std::cout << "      Ks: " << it->Ks << "\n";
         if (it->Ks != 0) std::cout << "      uk: " << str(it->uk) << "\n";
         }
+    std::cout << "periodic_boundary_conditions:\n";
+    std::cout << "  directions: [";
+    for (int d = 0, first = 1; d < Nodes::DIM; d++)
+        if (periodic[d])
+            {
+            std::cout << (first ? "" : ", ") << "XYZ"[d];
+            first = 0;
+            }
+    std::cout << "]\n";
+    std::cout << "  tolerance: " << periodicTol << "\n";
+    std::cout << "  image_shells: " << imageShells << "\n";
     std::cout << "initial_magnetization: ";
     if (!sM.empty())
         std::cout << str(sM) << "\n";
     else if (restoreFileName.empty())
         std::cout << "[\"" << sMx << "\", \"" << sMy << "\", \"" << sMz << "\"]\n";
-    else
+    else if (restoreMeshName.empty())
         std::cout << restoreFileName << "\n";
+    else
+        std::cout << "{sol: " << restoreFileName << ", mesh: " << restoreMeshName << "}\n";
     std::cout << "initial_time:";
     if (isnan(initial_time))
         std::cout << '\n';
     else
         std::cout << ' ' << initial_time << '\n';
+    std::cout << "temperature: " << temperature << "\n";
     std::cout << "recentering:\n";
     std::cout << "  enable: " << str(recenter) << "\n";
     if (recenter)
@@ -247,6 +275,54 @@ void Settings::toYaml()
 
     std::cout << "demagnetizing_field_solver:\n";
     std::cout << "  nb_threads: " << scalfmmNbTh << "\n";
+    std::cout << "  refresh_every: " << demagRefreshEvery << "\n";
+    std::cout << "  refresh_max(du): " << demagRefreshDu << "\n";
+    std::cout << "  method: ";
+    switch (demagMethod)
+        {
+        case FMM: std::cout << "fmm\n"; break;
+        case HMATRIX: std::cout << "hmatrix\n"; break;
+        case FFT: std::cout << "fft\n"; break;
+        }
+    std::cout << "  kernel: ";
+    switch (fmmKernel)
+        {
+        case ROTATION: std::cout << "rotation\n"; break;
+        case SPHERICAL: std::cout << "spherical\n"; break;
+        case CHEBYSHEV: std::cout << "chebyshev\n"; break;
+        case UNIFORM: std::cout << "uniform\n"; break;
+        }
+    std::cout << "  source_compression:\n";
+    std::cout << "    enable: " << str(fmmSourceCompression) << "\n";
+    std::cout << "    near_field_radius: " << fmmNearFieldRadius << "\n";
+    if (demagMethod == HMATRIX)
+        {
+        std::cout << "  hmatrix:\n";
+        std::cout << "    tolerance: " << hmatrixTol << "\n";
+        std::cout << "    admissibility: " << hmatrixEta << "\n";
+        std::cout << "    leaf_size: " << hmatrixLeafSize << "\n";
+        }
+    if (demagMethod == FFT)
+        {
+        std::cout << "  fft:\n";
+        std::cout << "    cells: " << fftCells << "\n";
+        std::cout << "    near_field_radius: " << fftNearFieldRadius << "\n";
+        }
+    std::cout << "probes:\n";
+    std::cout << "  points:";
+    if (probePoints.empty())
+        std::cout << " []\n";
+    else
+        {
+        std::cout << "\n";
+        for (Eigen::Vector3d const &p : probePoints)
+            std::cout << "    - " << str(p) << "\n";
+        }
+    std::cout << "  grid:\n";
+    std::cout << "    min: " << str(probeGridMin) << "\n";
+    std::cout << "    max: " << str(probeGridMax) << "\n";
+    std::cout << "    size: [" << probeGridSize.x() << ", " << probeGridSize.y() << ", "
+              << probeGridSize.z() << "]\n";
     std::cout << "finite_element_solver:\n";
     std::cout << "  nb_threads: " << solverNbTh << "\n";
     std::cout << "  max(iter): " << MAXITER << "\n";
@@ -257,6 +333,89 @@ void Settings::toYaml()
     std::cout << "  max(du): " << DUMAX << "\n";
     std::cout << "  min(dt): " << dt_min << "\n";
     std::cout << "  max(dt): " << dt_max << "\n";
+    std::cout << "  step_controller: " << (stepController == PI_CONTROLLER ? "pi" : "heuristic") << "\n";
+    std::cout << "  error_tolerance: " << errTol << "\n";
+    std::cout << "  stop_when:\n";
+    std::cout << "    max(torque): " << stopTorque << "\n";
+    std::cout << "    max(v): " << stopVmax << "\n";
+    std::cout << "    energy_change: " << stopEnergyChange << "\n";
+    std::cout << "    steps: " << stopSteps << "\n";
+    std::cout << "  active_set:\n";
+    std::cout << "    max(v): " << activeSetVmax << "\n";
+    std::cout << "    max(torque): " << activeSetTorque << "\n";
+    std::cout << "    steps: " << activeSetSteps << "\n";
+    std::cout << "    window: " << activeSetWindow << "\n";
+    std::cout << "    halo: " << activeSetHalo << "\n";
+    std::cout << "  multirate:\n";
+    std::cout << "    factor: " << multirateFactor << "\n";
+    std::cout << "    halo: " << multirateHalo << "\n";
+    std::cout << "mode: "
+              << (simMode == MINIMIZE ? "minimize"
+                  : simMode == GNEB   ? "gneb"
+                  : simMode == DIMER  ? "dimer"
+                  : simMode == HYSTERESIS ? "hysteresis"
+                  : simMode == EIGENMODES ? "eigenmodes"
+                  : simMode == PARAREAL   ? "parareal"
+                                          : "dynamics")
+              << "\n";
+    std::cout << "minimizer:\n";
+    std::cout << "  max(torque): " << minTorque << "\n";
+    std::cout << "  max(iter): " << minMaxIter << "\n";
+    std::cout << "gneb:\n";
+    std::cout << "  final_magnetization: " << gnebFinalFileName << "\n";
+    std::cout << "  images: " << gnebImages << "\n";
+    std::cout << "  spring_constant: " << gnebSpring << "\n";
+    std::cout << "  climbing_image: " << str(gnebClimbing) << "\n";
+    std::cout << "  climbing_after: " << gnebClimbingAfter << "\n";
+    std::cout << "  step: " << gnebStep << "\n";
+    std::cout << "  max(force): " << gnebMaxForce << "\n";
+    std::cout << "  max(iter): " << gnebMaxIter << "\n";
+    std::cout << "  concurrent_images: " << gnebConcurrent << "\n";
+    std::cout << "dimer:\n";
+    std::cout << "  length: " << dimerLength << "\n";
+    std::cout << "  step: " << dimerStep << "\n";
+    std::cout << "  max(force): " << dimerMaxForce << "\n";
+    std::cout << "  max(iter): " << dimerMaxIter << "\n";
+    std::cout << "hysteresis:\n";
+    std::cout << "  direction: " << str(hystDirection) << "\n";
+    std::cout << "  fields: [";
+    for (unsigned int k = 0; k < hystFields.size(); k++)
+        std::cout << (k ? ", " : "") << hystFields[k];
+    std::cout << "]\n";
+    std::cout << "  relaxation: " << (hystRelaxation == DYNAMICS ? "dynamics" : "minimize") << "\n";
+    std::cout << "eigenmodes:\n";
+    std::cout << "  count: " << eigCount << "\n";
+    std::cout << "  krylov_dimension: " << eigKrylovDim << "\n";
+    std::cout << "  tolerance: " << eigTol << "\n";
+    std::cout << "  max(iter): " << eigMaxIter << "\n";
+    std::cout << "parareal:\n";
+    std::cout << "  slices: " << pararealSlices << "\n";
+    std::cout << "  max(iter): " << pararealMaxIter << "\n";
+    std::cout << "  tolerance: " << pararealTol << "\n";
+    std::cout << "  coarse:\n";
+    std::cout << "    max(dt): " << pararealCoarseDtMax << "\n";
+    std::cout << "    max(du): " << pararealCoarseDumax << "\n";
+    std::cout << "    demag_refresh_every: " << pararealCoarseDemagEvery << "\n";
+    std::cout << "multiresolution:\n";
+    std::cout << "  meshes: [";
+    for (unsigned int k = 0; k < multiresMeshes.size(); k++)
+        std::cout << (k ? ", " : "") << multiresMeshes[k];
+    std::cout << "]\n";
+    std::cout << "batch:\n";
+    std::cout << "  runs:";
+    if (batchRuns.empty())
+        std::cout << " []\n";
+    else
+        {
+        std::cout << "\n";
+        for (YAML::Node const &run : batchRuns)
+            {
+            YAML::Emitter out;
+            out << YAML::Flow << run;
+            std::cout << "    - " << out.c_str() << "\n";
+            }
+        }
+    std::cout << "  concurrent: " << batchConcurrent << "\n";
     }
 
 std::ostringstream Settings::commonMetadata() const
@@ -292,6 +451,50 @@ std::string Settings::evolMetadata() const
     return ss.str();
     }
 
+std::string Settings::probesMetadata() const
+    {
+    std::ostringstream ss = commonMetadata();
+    ss << tags::evol::columns << " t\tx\ty\tz\tphi\tHx\tHy\tHz" << std::endl;
+    return ss.str();
+    }
+
+std::string Settings::columnsMetadata(std::string const &columns) const
+    {
+    std::ostringstream ss = commonMetadata();
+    ss << tags::evol::columns << ' ' << columns << std::endl;
+    return ss.str();
+    }
+
+void Settings::setConstantField(Eigen::Vector3d const &B)
+    {
+    std::ostringstream ss;
+    ss.precision(17);
+    ss << B.x();
+    sBx = ss.str();
+    ss.str("");
+    ss << B.y();
+    sBy = ss.str();
+    ss.str("");
+    ss << B.z();
+    sBz = ss.str();
+    sB.clear();
+    field_parser.set_expressions("t", sBx, sBy, sBz);
+    field_type = RtoR3;
+    }
+
+bool Settings::isFieldConstant(void) const
+    {
+    if (field_type != RtoR3 || !sB.empty()) return false;
+    for (std::string const &s : {sBx, sBy, sBz})
+        {
+        char *end;
+        std::strtod(s.c_str(), &end);
+        while (isspace(*end)) end++;
+        if (end == s.c_str() || *end != '\0') return false;
+        }
+    return true;
+    }
+
 std::string Settings::solMetadata(double t, std::string columnsTitle) const
     {
     std::ostringstream ss = commonMetadata();
@@ -302,6 +505,7 @@ std::string Settings::solMetadata(double t, std::string columnsTitle) const
 
 void Settings::read(YAML::Node yaml)
     {
+    documents.push_back(yaml);
     YAML::Node outputs = yaml["outputs"];
     if (outputs && !outputs.IsNull())
         {
@@ -321,6 +525,7 @@ void Settings::read(YAML::Node yaml)
         assign(simName, outputs["file_basename"]);
         assign(time_step, outputs["evol_time_step"]);
         assign(tf, outputs["final_time"]);
+        assign(denseOutput, outputs["dense_output"]);
         YAML::Node mag_config_every = outputs["mag_config_every"];
         if (mag_config_every.Scalar() == "true")
             {  // catch an easy mistake
@@ -380,8 +585,12 @@ void Settings::read(YAML::Node yaml)
                 {
                 std::string name = it->first.as<std::string>();
                 YAML::Node volume = it->second;
+                int idx = findTetraRegionIdx(name);  // a region read again is overridden
                 Tetra::prm p;
-                if (default_idx >= 0) p = paramTetra[default_idx];
+                if (idx >= 0)
+                    p = paramTetra[idx];
+                else if (default_idx >= 0)
+                    p = paramTetra[default_idx];
                 p.regName = name;
                 assign(p.A, volume["Ae"]);
                 assign(p.J, volume["Js"]);
@@ -394,6 +603,7 @@ void Settings::read(YAML::Node yaml)
                 if (!isOrthogonal(p.ex, p.ey, p.ez, USER_TOL))
                     std::cout << "Warning: (ex, ey, ez) is not orthogonal.\n";
                 assign(p.alpha_LLG, volume["alpha_LLG"]);
+                assign(p.frozen, volume["frozen"]);
 
                 // XXX: These should come from the configuration file.
                 p.p_STT.beta = 0.0;
@@ -403,7 +613,10 @@ void Settings::read(YAML::Node yaml)
                 p.p_STT.lsf = 1.0;
                 p.p_STT.V_file = false;
 
-                paramTetra.push_back(p);
+                if (idx >= 0)
+                    paramTetra[idx] = p;
+                else
+                    paramTetra.push_back(p);
                 }
             }  // mesh.volume_regions
         YAML::Node surfaces = mesh["surface_regions"];
@@ -415,17 +628,52 @@ void Settings::read(YAML::Node yaml)
                 {
                 std::string name = it->first.as<std::string>();
                 YAML::Node surface = it->second;
+                int idx = findFacetteRegionIdx(name);  // a region read again is overridden
                 Facette::prm p;
-                if (default_idx >= 0) p = paramFacette[default_idx];
+                if (idx >= 0)
+                    p = paramFacette[idx];
+                else if (default_idx >= 0)
+                    p = paramFacette[default_idx];
                 p.regName = name;
                 assign(p.suppress_charges, surface["suppress_charges"]);
                 assign(p.Ks, surface["Ks"]);
                 assign(p.uk, surface["uk"]);
-                paramFacette.push_back(p);
+                if (idx >= 0)
+                    paramFacette[idx] = p;
+                else
+                    paramFacette.push_back(p);
                 }
             }  // mesh.surface_regions
         }      // mesh
 
+    YAML::Node pbc = yaml["periodic_boundary_conditions"];
+    if (pbc && !pbc.IsNull())
+        {
+        YAML::Node directions = pbc["directions"];
+        if (directions && !directions.IsNull())
+            {
+            if (!directions.IsSequence())
+                error("periodic_boundary_conditions.directions should be a sequence.");
+            periodic.fill(false);
+            for (auto it = directions.begin(); it != directions.end(); ++it)
+                {
+                std::string dir = it->as<std::string>();
+                if (dir == "X")
+                    periodic[Nodes::IDX_X] = true;
+                else if (dir == "Y")
+                    periodic[Nodes::IDX_Y] = true;
+                else if (dir == "Z")
+                    periodic[Nodes::IDX_Z] = true;
+                else
+                    error("periodic_boundary_conditions.directions should be X, Y or Z.");
+                }
+            }
+        if (assign(periodicTol, pbc["tolerance"]) && periodicTol <= 0)
+            error("periodic_boundary_conditions.tolerance should be positive.");
+        if (assign(imageShells, pbc["image_shells"]) && imageShells < -1)
+            error("periodic_boundary_conditions.image_shells should be at least -1.");
+        }  // periodic_boundary_conditions
+
     YAML::Node magnetization = yaml["initial_magnetization"];
     if (magnetization && !magnetization.IsNull())
         {
@@ -435,10 +683,14 @@ void Settings::read(YAML::Node yaml)
             if (s_mag.find("function") == std::string::npos || s_mag.find('{') == std::string::npos)
                 {
                 restoreFileName = s_mag;
+                restoreMeshName.clear();
+                sM.clear();
                 }
             else
                 {
                 sM = s_mag;
+                restoreFileName.clear();
+                restoreMeshName.clear();
                 mag_parser.set_function(sM);
                 }
             }
@@ -449,15 +701,28 @@ void Settings::read(YAML::Node yaml)
             sMx = magnetization[0].as<std::string>();
             sMy = magnetization[1].as<std::string>();
             sMz = magnetization[2].as<std::string>();
+            sM.clear();
+            restoreFileName.clear();
+            restoreMeshName.clear();
             mag_parser.set_expressions("x,y,z", sMx, sMy, sMz);
             }
+        else if (magnetization.IsMap())
+            {
+            if (!assign(restoreFileName, magnetization["sol"])
+                || !assign(restoreMeshName, magnetization["mesh"]))
+                error("initial_magnetization should have both a sol and a mesh file.");
+            sM.clear();
+            }
         else
             {
-            error("initial_magnetization should be a file name or a vector of expressions.");
+            error("initial_magnetization should be a file name, a vector of expressions, or a "
+                  "map of a sol and a mesh file.");
             }
         }  // initial_magnetization
 
     assign(initial_time, yaml["initial_time"]);
+    if (assign(temperature, yaml["temperature"]) && temperature < 0)
+        error("temperature should be positive or zero.");
 
     YAML::Node recentering = yaml["recentering"];
     if (recentering && !recentering.IsNull())
@@ -490,6 +755,7 @@ void Settings::read(YAML::Node yaml)
             sBx = field[0].as<std::string>();
             sBy = field[1].as<std::string>();
             sBz = field[2].as<std::string>();
+            sB.clear();
             field_parser.set_expressions("t", sBx, sBy, sBz);
             field_type = RtoR3;
             }
@@ -553,8 +819,95 @@ void Settings::read(YAML::Node yaml)
         {
         assign(scalfmmNbTh, solver["nb_threads"]);
         if (scalfmmNbTh <= 0) scalfmmNbTh = available_cpu_count;
+        if (assign(demagRefreshEvery, solver["refresh_every"]) && demagRefreshEvery < 0)
+            error("demagnetizing_field_solver.refresh_every should be non negative.");
+        if (assign(demagRefreshDu, solver["refresh_max(du)"]) && demagRefreshDu < 0)
+            error("demagnetizing_field_solver.refresh_max(du) should be non negative.");
+        if (demagRefreshEvery == 0 && demagRefreshDu == 0)
+            error("demagnetizing_field_solver: refresh_every and refresh_max(du) cannot both be zero.");
+        std::string method;
+        if (assign(method, solver["method"]))
+            {
+            if (method == "fmm")
+                demagMethod = FMM;
+            else if (method == "hmatrix")
+                demagMethod = HMATRIX;
+            else if (method == "fft")
+                demagMethod = FFT;
+            else
+                error("demagnetizing_field_solver.method should be fmm, hmatrix or fft.");
+            }
+        std::string kernel;
+        if (assign(kernel, solver["kernel"]))
+            {
+            if (kernel == "rotation")
+                fmmKernel = ROTATION;
+            else if (kernel == "spherical")
+                fmmKernel = SPHERICAL;
+            else if (kernel == "chebyshev")
+                fmmKernel = CHEBYSHEV;
+            else if (kernel == "uniform")
+                fmmKernel = UNIFORM;
+            else
+                error("demagnetizing_field_solver.kernel should be rotation, spherical, chebyshev or uniform.");
+            }
+        YAML::Node compression = solver["source_compression"];
+        if (compression && !compression.IsNull())
+            {
+            assign(fmmSourceCompression, compression["enable"]);
+            if (assign(fmmNearFieldRadius, compression["near_field_radius"]) && fmmNearFieldRadius <= 0)
+                error("demagnetizing_field_solver.source_compression.near_field_radius should be positive.");
+            }
+        YAML::Node hmatrix = solver["hmatrix"];
+        if (hmatrix && !hmatrix.IsNull())
+            {
+            if (assign(hmatrixTol, hmatrix["tolerance"]) && hmatrixTol <= 0)
+                error("demagnetizing_field_solver.hmatrix.tolerance should be positive.");
+            if (assign(hmatrixEta, hmatrix["admissibility"]) && hmatrixEta <= 0)
+                error("demagnetizing_field_solver.hmatrix.admissibility should be positive.");
+            if (assign(hmatrixLeafSize, hmatrix["leaf_size"]) && hmatrixLeafSize <= 0)
+                error("demagnetizing_field_solver.hmatrix.leaf_size should be positive.");
+            }
+        YAML::Node fft = solver["fft"];
+        if (fft && !fft.IsNull())
+            {
+            if (assign(fftCells, fft["cells"]) && fftCells <= 0)
+                error("demagnetizing_field_solver.fft.cells should be positive.");
+            if (assign(fftNearFieldRadius, fft["near_field_radius"]) && fftNearFieldRadius < 0)
+                error("demagnetizing_field_solver.fft.near_field_radius should be non negative.");
+            }
         }  // demagnetizing_field_solver
 
+    YAML::Node probes = yaml["probes"];
+    if (probes && !probes.IsNull())
+        {
+        YAML::Node points = probes["points"];
+        if (points && !points.IsNull())
+            {
+            if (!points.IsSequence()) error("probes.points should be a sequence.");
+            probePoints.resize(points.size());
+            for (unsigned int i = 0; i < points.size(); i++)
+                assign_point(probePoints[i], points[i]);
+            }
+        YAML::Node grid = probes["grid"];
+        if (grid && !grid.IsNull())
+            {
+            assign_point(probeGridMin, grid["min"]);
+            assign_point(probeGridMax, grid["max"]);
+            YAML::Node size = grid["size"];
+            if (size && !size.IsNull())
+                {
+                if (!size.IsSequence() || size.size() != 3)
+                    error("probes.grid.size should be a sequence of three integers.");
+                probeGridSize = { size[0].as<int>(), size[1].as<int>(), size[2].as<int>() };
+                if (probeGridSize.minCoeff() < 0)
+                    error("probes.grid.size should be non negative.");
+                }
+            }
+        if (!getProbes().empty() && demagMethod != FMM)
+            error("probes are only computed by demagnetizing_field_solver.method fmm.");
+        }  // probes
+
     solver = yaml["finite_element_solver"];
     if (solver && !solver.IsNull())
         {
@@ -572,8 +925,267 @@ void Settings::read(YAML::Node yaml)
         assign(DUMAX, time_integration["max(du)"]);
         assign(dt_min, time_integration["min(dt)"]);
         assign(dt_max, time_integration["max(dt)"]);
+        std::string controller;
+        if (assign(controller, time_integration["step_controller"]))
+            {
+            if (controller == "heuristic")
+                stepController = HEURISTIC;
+            else if (controller == "pi")
+                stepController = PI_CONTROLLER;
+            else
+                error("time_integration.step_controller should be heuristic or pi.");
+            }
+        if (assign(errTol, time_integration["error_tolerance"]) && errTol <= 0)
+            error("time_integration.error_tolerance should be positive.");
+        YAML::Node stop_when = time_integration["stop_when"];
+        if (stop_when && !stop_when.IsNull())
+            {
+            if (assign(stopTorque, stop_when["max(torque)"]) && stopTorque < 0)
+                error("time_integration.stop_when.max(torque) should be positive or zero.");
+            if (assign(stopVmax, stop_when["max(v)"]) && stopVmax < 0)
+                error("time_integration.stop_when.max(v) should be positive or zero.");
+            if (assign(stopEnergyChange, stop_when["energy_change"]) && stopEnergyChange < 0)
+                error("time_integration.stop_when.energy_change should be positive or zero.");
+            if (assign(stopSteps, stop_when["steps"]) && stopSteps <= 0)
+                error("time_integration.stop_when.steps should be positive.");
+            }  // stop_when
+        YAML::Node active_set = time_integration["active_set"];
+        if (active_set && !active_set.IsNull())
+            {
+            if (assign(activeSetVmax, active_set["max(v)"]) && activeSetVmax < 0)
+                error("time_integration.active_set.max(v) should be positive or zero.");
+            if (assign(activeSetTorque, active_set["max(torque)"]) && activeSetTorque < 0)
+                error("time_integration.active_set.max(torque) should be positive or zero.");
+            if (assign(activeSetSteps, active_set["steps"]) && activeSetSteps <= 0)
+                error("time_integration.active_set.steps should be positive.");
+            if (assign(activeSetWindow, active_set["window"]) && activeSetWindow < 2)
+                error("time_integration.active_set.window should be at least 2.");
+            if (assign(activeSetHalo, active_set["halo"]) && activeSetHalo < 0)
+                error("time_integration.active_set.halo should be positive or zero.");
+            }  // active_set
+        YAML::Node multirate = time_integration["multirate"];
+        if (multirate && !multirate.IsNull())
+            {
+            if (assign(multirateFactor, multirate["factor"]) && multirateFactor <= 0)
+                error("time_integration.multirate.factor should be positive.");
+            if (assign(multirateHalo, multirate["halo"]) && multirateHalo < 0)
+                error("time_integration.multirate.halo should be positive or zero.");
+            }  // multirate
         }  // time_integration
 
+    std::string mode;
+    if (assign(mode, yaml["mode"]))
+        {
+        if (mode == "dynamics")
+            simMode = DYNAMICS;
+        else if (mode == "minimize")
+            simMode = MINIMIZE;
+        else if (mode == "gneb")
+            simMode = GNEB;
+        else if (mode == "dimer")
+            simMode = DIMER;
+        else if (mode == "hysteresis")
+            simMode = HYSTERESIS;
+        else if (mode == "eigenmodes")
+            simMode = EIGENMODES;
+        else if (mode == "parareal")
+            simMode = PARAREAL;
+        else
+            error("mode should be dynamics, minimize, gneb, dimer, hysteresis, eigenmodes or parareal.");
+        }
+
+    YAML::Node minimizer = yaml["minimizer"];
+    if (minimizer && !minimizer.IsNull())
+        {
+        if (assign(minTorque, minimizer["max(torque)"]) && minTorque <= 0)
+            error("minimizer.max(torque) should be positive.");
+        if (assign(minMaxIter, minimizer["max(iter)"]) && minMaxIter <= 0)
+            error("minimizer.max(iter) should be positive.");
+        }  // minimizer
+
+    YAML::Node gneb = yaml["gneb"];
+    if (gneb && !gneb.IsNull())
+        {
+        assign(gnebFinalFileName, gneb["final_magnetization"]);
+        if (assign(gnebImages, gneb["images"]) && gnebImages < 3)
+            error("gneb.images should be at least 3.");
+        if (assign(gnebSpring, gneb["spring_constant"]) && gnebSpring < 0)
+            error("gneb.spring_constant should be positive.");
+        assign(gnebClimbing, gneb["climbing_image"]);
+        if (assign(gnebClimbingAfter, gneb["climbing_after"]) && gnebClimbingAfter < 0)
+            error("gneb.climbing_after should be positive.");
+        if (assign(gnebStep, gneb["step"]) && gnebStep <= 0)
+            error("gneb.step should be positive.");
+        if (assign(gnebMaxForce, gneb["max(force)"]) && gnebMaxForce <= 0)
+            error("gneb.max(force) should be positive.");
+        if (assign(gnebMaxIter, gneb["max(iter)"]) && gnebMaxIter <= 0)
+            error("gneb.max(iter) should be positive.");
+        if (assign(gnebConcurrent, gneb["concurrent_images"]) && gnebConcurrent <= 0)
+            error("gneb.concurrent_images should be positive.");
+        }  // gneb
+    if (simMode == GNEB && gnebFinalFileName.empty())
+        error("gneb.final_magnetization is required in gneb mode.");
+
+    YAML::Node dimer = yaml["dimer"];
+    if (dimer && !dimer.IsNull())
+        {
+        if (assign(dimerLength, dimer["length"]) && dimerLength <= 0)
+            error("dimer.length should be positive.");
+        if (assign(dimerStep, dimer["step"]) && dimerStep <= 0)
+            error("dimer.step should be positive.");
+        if (assign(dimerMaxForce, dimer["max(force)"]) && dimerMaxForce <= 0)
+            error("dimer.max(force) should be positive.");
+        if (assign(dimerMaxIter, dimer["max(iter)"]) && dimerMaxIter <= 0)
+            error("dimer.max(iter) should be positive.");
+        }  // dimer
+
+    YAML::Node hysteresis = yaml["hysteresis"];
+    if (hysteresis && !hysteresis.IsNull())
+        {
+        if (assign(hystDirection, hysteresis["direction"]))
+            {
+            if (hystDirection.norm() == 0) error("hysteresis.direction should not be zero.");
+            hystDirection.normalize();
+            }
+        YAML::Node fields = hysteresis["fields"];
+        if (fields && !fields.IsNull())
+            {
+            if (!fields.IsSequence()) error("hysteresis.fields should be a sequence.");
+            hystFields.resize(fields.size());
+            for (unsigned int k = 0; k < fields.size(); k++)
+                hystFields[k] = fields[k].as<double>();
+            }
+        std::string relaxation;
+        if (assign(relaxation, hysteresis["relaxation"]))
+            {
+            if (relaxation == "minimize")
+                hystRelaxation = MINIMIZE;
+            else if (relaxation == "dynamics")
+                hystRelaxation = DYNAMICS;
+            else
+                error("hysteresis.relaxation should be minimize or dynamics.");
+            }
+        }  // hysteresis
+    if (simMode == HYSTERESIS)
+        {
+        if (hystFields.empty())
+            error("hysteresis.fields should not be empty in hysteresis mode.");
+        if (hystRelaxation == DYNAMICS && !stopAtEquilibrium())
+            error("hysteresis.relaxation dynamics requires time_integration.stop_when criteria.");
+        }
+
+    YAML::Node eigenmodes = yaml["eigenmodes"];
+    if (eigenmodes && !eigenmodes.IsNull())
+        {
+        if (assign(eigCount, eigenmodes["count"]) && eigCount <= 0)
+            error("eigenmodes.count should be positive.");
+        if (assign(eigKrylovDim, eigenmodes["krylov_dimension"]) && eigKrylovDim <= 0)
+            error("eigenmodes.krylov_dimension should be positive.");
+        if (assign(eigTol, eigenmodes["tolerance"]) && eigTol <= 0)
+            error("eigenmodes.tolerance should be positive.");
+        if (assign(eigMaxIter, eigenmodes["max(iter)"]) && eigMaxIter <= 0)
+            error("eigenmodes.max(iter) should be positive.");
+        }  // eigenmodes
+    if (simMode == EIGENMODES && eigKrylovDim < 2 * eigCount)
+        error("eigenmodes.krylov_dimension should be at least twice eigenmodes.count.");
+
+    YAML::Node parareal = yaml["parareal"];
+    if (parareal && !parareal.IsNull())
+        {
+        if (assign(pararealSlices, parareal["slices"]) && pararealSlices <= 0)
+            error("parareal.slices should be positive.");
+        if (assign(pararealMaxIter, parareal["max(iter)"]) && pararealMaxIter <= 0)
+            error("parareal.max(iter) should be positive.");
+        if (assign(pararealTol, parareal["tolerance"]) && pararealTol <= 0)
+            error("parareal.tolerance should be positive.");
+        YAML::Node coarse = parareal["coarse"];
+        if (coarse && !coarse.IsNull())
+            {
+            if (assign(pararealCoarseDtMax, coarse["max(dt)"]) && pararealCoarseDtMax <= 0)
+                error("parareal.coarse.max(dt) should be positive.");
+            if (assign(pararealCoarseDumax, coarse["max(du)"]) && pararealCoarseDumax <= 0)
+                error("parareal.coarse.max(du) should be positive.");
+            if (assign(pararealCoarseDemagEvery, coarse["demag_refresh_every"])
+                && pararealCoarseDemagEvery <= 0)
+                error("parareal.coarse.demag_refresh_every should be positive.");
+            }  // coarse
+        }  // parareal
+    if (simMode == PARAREAL)
+        {
+        if (temperature > 0) error("parareal mode is not supported with a temperature.");
+        if (recenter) error("parareal mode is not supported with recentering.");
+        if (denseOutput) error("parareal mode is not supported with outputs.dense_output.");
+        if (!getProbes().empty()) error("parareal mode is not supported with probes.");
+        if (activeSetVmax > 0 || multirateFactor > 1)
+            error("parareal mode is not supported with time_integration.active_set or multirate.");
+        if (!batchRuns.empty()) error("parareal mode is not supported in a batch.");
+        }
+
+    YAML::Node multiresolution = yaml["multiresolution"];
+    if (multiresolution && !multiresolution.IsNull())
+        {
+        YAML::Node meshes = multiresolution["meshes"];
+        if (meshes && !meshes.IsNull())
+            {
+            if (!meshes.IsSequence()) error("multiresolution.meshes should be a sequence.");
+            multiresMeshes.resize(meshes.size());
+            for (unsigned int k = 0; k < meshes.size(); k++)
+                multiresMeshes[k] = meshes[k].as<std::string>();
+            }
+        }  // multiresolution
+    if (!multiresMeshes.empty() && !restoreFileName.empty())
+        error("multiresolution requires an analytic initial_magnetization.");
+
+    YAML::Node batch = yaml["batch"];
+    if (batch && !batch.IsNull())
+        {
+        YAML::Node runs = batch["runs"];
+        if (runs && !runs.IsNull())
+            {
+            if (!runs.IsSequence()) error("batch.runs should be a sequence.");
+            batchRuns.clear();
+            for (auto it = runs.begin(); it != runs.end(); ++it)
+                {
+                if (!it->IsMap()) error("batch.runs should be a sequence of maps.");
+                if ((*it)["batch"]) error("batch.runs cannot contain a batch section.");
+                batchRuns.push_back(*it);
+                }
+            }
+        if (assign(batchConcurrent, batch["concurrent"]) && batchConcurrent <= 0)
+            error("batch.concurrent should be positive.");
+        }  // batch
+
+    if (denseOutput && recenter)
+        error("outputs.dense_output is not supported with recentering.");
+    if (multirateFactor > 1)
+        {
+        if (denseOutput)
+            error("outputs.dense_output is not supported with time_integration.multirate.");
+        if (activeSetVmax > 0)
+            error("time_integration.active_set is not supported with time_integration.multirate.");
+        }
+    // all the nodes are solved again when the energy increases: it must be a Lyapunov function
+    if (activeSetVmax > 0)
+        {
+        if (temperature > 0)
+            error("time_integration.active_set is not supported with a temperature.");
+        // the hysteresis mode replaces Bext by a constant field
+        if (simMode != HYSTERESIS && !isFieldConstant())
+            error("time_integration.active_set is not supported with a time dependent Bext.");
+        if (stt_flag)
+            error("time_integration.active_set is not supported with spin_transfer_torque.");
+        }
+
+    if (isPeriodic())
+        {
+        if (demagMethod != FMM)
+            error("periodic boundary conditions are only supported by demagnetizing_field_solver.method fmm.");
+        if (fmmSourceCompression)
+            error("periodic boundary conditions are not supported with source_compression.");
+        if (!getProbes().empty())
+            error("periodic boundary conditions are not supported with probes.");
+        }
+
     // outputs.file_basename defaults to base name of mesh.filename.
     if (simName.empty() && !pbName.empty())
         {
@@ -589,6 +1201,25 @@ void Settings::read(YAML::Node yaml)
         }
     }
 
+std::vector<Eigen::Vector3d> Settings::getProbes(void) const
+    {
+    std::vector<Eigen::Vector3d> probes;
+    for (Eigen::Vector3d const &p : probePoints)
+        probes.push_back(_scale * p);
+    if (probeGridSize.minCoeff() > 0)
+        {
+        Eigen::Vector3d step = Eigen::Vector3d::Zero();
+        for (int d = 0; d < 3; d++)
+            if (probeGridSize(d) > 1)
+                step(d) = (probeGridMax(d) - probeGridMin(d)) / (probeGridSize(d) - 1);
+        for (int k = 0; k < probeGridSize.z(); k++)
+            for (int j = 0; j < probeGridSize.y(); j++)
+                for (int i = 0; i < probeGridSize.x(); i++)
+                    probes.push_back(_scale * (probeGridMin + step.cwiseProduct(Eigen::Vector3d(i, j, k))));
+        }
+    return probes;
+    }
+
 bool Settings::read(std::string filename)
     {
     YAML::Node config;
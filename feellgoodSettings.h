@@ -6,9 +6,14 @@
 output file format wanted by the user. This is done mainly with the class Settings.
 */
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <map>
+#include <optional>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -37,6 +42,70 @@ enum field_exprType
                  /// and **f**(x, y, z) is a vector
     };
 
+/** Algorithm used for the computation of the demagnetizing field. The choices are:
+ *
+ * * `FMM`: fast multipole method, computed by ScalFMM on every call.
+ * * `HMATRIX`: hierarchical matrix, the charge to potential operator is compressed once with the
+ *   adaptive cross approximation, each call is then a matrix vector product.
+ * * `FFT`: convolution computed with FFT on an auxiliary regular grid, with a near field correction.
+ */
+enum demag_method
+    {
+    FMM = 0,      ///< fast multipole method
+    HMATRIX = 1,  ///< hierarchical matrix
+    FFT = 2       ///< FFT on a regular grid
+    };
+
+/** Kernel of the fast multipole algorithm (ScalFMM). The choices are:
+ *
+ * * `ROTATION`: spherical harmonics expansions with rotation based translations.
+ * * `SPHERICAL`: spherical harmonics expansions with classical translations.
+ * * `CHEBYSHEV`: Chebyshev interpolation.
+ * * `UNIFORM`: Lagrange interpolation on uniform grids, translations computed with FFT.
+ */
+enum fmm_kernel
+    {
+    ROTATION = 0,   ///< rotation kernel
+    SPHERICAL = 1,  ///< spherical kernel
+    CHEBYSHEV = 2,  ///< Chebyshev interpolation kernel
+    UNIFORM = 3     ///< uniform interpolation kernel
+    };
+
+/** Simulation mode. The choices are:
+ *
+ * * `DYNAMICS`: integration in time of the LLG equation.
+ * * `MINIMIZE`: direct minimization of the total energy, to find an equilibrium state.
+ * * `GNEB`: geodesic nudged elastic band, to find the minimum energy path between two states.
+ * * `DIMER`: minimum mode following from a single state, to find a first order saddle point.
+ * * `HYSTERESIS`: quasi-static sweep of a uniform applied field, relaxed on every field value.
+ * * `EIGENMODES`: lowest frequency spin wave modes of the LLG equation linearized around an
+ *   equilibrium.
+ * * `PARAREAL`: integration in time of the LLG equation, parallel over time slices.
+ */
+enum simulation_mode
+    {
+    DYNAMICS = 0,  ///< time integration
+    MINIMIZE = 1,  ///< energy minimization
+    GNEB = 2,      ///< minimum energy path
+    DIMER = 3,     ///< saddle point search
+    HYSTERESIS = 4, ///< quasi-static hysteresis loop
+    EIGENMODES = 5, ///< spin wave eigenmodes
+    PARAREAL = 6    ///< parallel in time integration
+    };
+
+/** Time step controller of the time integration. The choices are:
+ *
+ * * `HEURISTIC`: the time step grows by 10% per step, and is halved when the solver fails or when
+ *   the variation of the magnetization exceeds `DUMAX`.
+ * * `PI_CONTROLLER`: the time step is predicted by a proportional-integral controller from a local
+ *   error estimate, still bounded by `DUMAX`.
+ */
+enum step_controller
+    {
+    HEURISTIC = 0,     ///< growth and halving heuristic
+    PI_CONTROLLER = 1  ///< proportional-integral controller on the local error
+    };
+
 /**
  * \class Settings
  *
@@ -79,6 +148,12 @@ public:
     /** build a metadata string for .evol file */
     std::string evolMetadata() const;
 
+    /** build a metadata string for the _probes.evol file */
+    std::string probesMetadata() const;
+
+    /** build a metadata string for an output file with the given tab separated column titles */
+    std::string columnsMetadata(std::string const &columns) const;
+
     /** build a metadata string for .sol text files */
     std::string solMetadata(double t, std::string columnsTitle) const;
 
@@ -127,6 +202,10 @@ public:
     /** energy saved every time_step */
     double time_step;
 
+    /** if true, the integrator is not forced to land on the output times, the outputs are
+     * interpolated from the bracketing time steps */
+    bool denseOutput;
+
     /** magnetic configuration saved every save_period time steps */
     int save_period;
 
@@ -145,6 +224,73 @@ public:
     /** nb of threads for the computation of the demag field with scalfmm */
     int scalfmmNbTh;
 
+    /** kernel of the fast multipole algorithm */
+    fmm_kernel fmmKernel;
+
+    /** far field source compression for the fast multipole algorithm: one source per element */
+    bool fmmSourceCompression;
+
+    /** with far field source compression, the exact point charges of an element are used for the
+     * nodes closer to its barycenter than fmmNearFieldRadius times its diameter */
+    double fmmNearFieldRadius;
+
+    /** algorithm for the computation of the demag field */
+    demag_method demagMethod;
+
+    /** the demag potentials are recomputed at least every demagRefreshEvery accepted time steps,
+     * 0 disables this criterion */
+    int demagRefreshEvery;
+
+    /** the demag potentials are recomputed when the maximum variation of the magnetization since
+     * the last computation exceeds demagRefreshDu, 0 disables this criterion */
+    double demagRefreshDu;
+
+    /** relative tolerance of the adaptive cross approximation of the hierarchical matrix */
+    double hmatrixTol;
+
+    /** admissibility parameter of the hierarchical matrix: a block is compressed if the smallest
+     * diameter of its clusters is less than hmatrixEta times their distance */
+    double hmatrixEta;
+
+    /** maximum number of points in the leaves of the cluster trees of the hierarchical matrix */
+    int hmatrixLeafSize;
+
+    /** number of cells of the grid of the FFT demag solver along the largest dimension of the mesh */
+    int fftCells;
+
+    /** the grid interaction between a node and a source closer than fftNearFieldRadius grid cells
+     * is replaced by the exact interaction */
+    double fftNearFieldRadius;
+
+    /** periodic directions */
+    std::array<bool, Nodes::DIM> periodic;
+
+    /** nodes of opposite periodic faces are images of each other if their distance, once
+     * translated by the period, is less than periodicTol times the period */
+    double periodicTol;
+
+    /** number of levels of periodic images above the octree root for the demag field */
+    int imageShells;
+
+    /** \return true if there is at least one periodic direction */
+    inline bool isPeriodic(void) const
+        { return std::any_of(periodic.begin(), periodic.end(), [](bool p) { return p; }); }
+
+    /** stray field probes, as a list of points in the length unit of the mesh */
+    std::vector<Eigen::Vector3d> probePoints;
+
+    /** lower corner of the grid of probes, in the length unit of the mesh */
+    Eigen::Vector3d probeGridMin;
+
+    /** upper corner of the grid of probes, in the length unit of the mesh */
+    Eigen::Vector3d probeGridMax;
+
+    /** number of probes of the grid along each axis, there is no grid if one of them is zero */
+    Eigen::Vector3i probeGridSize;
+
+    /** \return positions of all the probes (list of points, then grid), in meters */
+    std::vector<Eigen::Vector3d> getProbes(void) const;
+
     /** spin transfert torque parameters */
     STT p_stt;
 
@@ -184,9 +330,15 @@ public:
     /** input file name for continuing a calculation (sol.in) */
     std::string restoreFileName;
 
+    /** mesh file of restoreFileName, if it is not the mesh of the simulation, empty otherwise */
+    std::string restoreMeshName;
+
     /** initial time for the simulation, if defined in the settings file, NAN otherwise */
     double initial_time = NAN;
 
+    /** temperature of the thermal fluctuation field, in kelvin, 0 for none */
+    double temperature;
+
     /** maximum value for du step */
     double DUMAX;  // 0.1 for magnetostatic simulations; 0.02 for the dynamics
 
@@ -246,6 +398,162 @@ public:
     /** maximal time step */
     double dt_max;
 
+    /** simulation mode */
+    simulation_mode simMode;
+
+    /** convergence criterion of the energy minimization, on the maximum torque \f$ \mu_0 |u \times
+     * H_{\mathrm{eff}}| \f$, in tesla */
+    double minTorque;
+
+    /** maximum number of iterations of the energy minimization */
+    int minMaxIter;
+
+    /** .sol file of the final state of the path, the initial state is the initial magnetization */
+    std::string gnebFinalFileName;
+
+    /** number of images of the path, including both ends */
+    int gnebImages;
+
+    /** spring constant between the images, in tesla per radian */
+    double gnebSpring;
+
+    /** if true, the image of highest energy climbs up to the saddle point */
+    bool gnebClimbing;
+
+    /** number of iterations before the climbing image is switched on */
+    int gnebClimbingAfter;
+
+    /** step of the velocity projection optimizer */
+    double gnebStep;
+
+    /** convergence criterion on the maximum force on the images, in tesla */
+    double gnebMaxForce;
+
+    /** maximum number of iterations of the path optimization */
+    int gnebMaxIter;
+
+    /** number of images whose effective fields are evaluated concurrently */
+    int gnebConcurrent;
+
+    /** length of the dimer, in radians, used to estimate the curvature by finite differences */
+    double dimerLength;
+
+    /** step of the translation of the dimer, in radians per tesla */
+    double dimerStep;
+
+    /** convergence criterion on the maximum force at the center of the dimer, in tesla */
+    double dimerMaxForce;
+
+    /** maximum number of iterations of the saddle point search */
+    int dimerMaxIter;
+
+    /** direction of the applied field of the hysteresis loop, unit vector */
+    Eigen::Vector3d hystDirection;
+
+    /** values of the applied field of the hysteresis loop along hystDirection, in tesla */
+    std::vector<double> hystFields;
+
+    /** relaxation on each field value of the hysteresis loop, either MINIMIZE or DYNAMICS */
+    simulation_mode hystRelaxation;
+
+    /** number of eigenmodes to compute */
+    int eigCount;
+
+    /** dimension of the Krylov subspace of the Arnoldi iteration */
+    int eigKrylovDim;
+
+    /** relative tolerance of the eigenpairs, and of the linear solves of the shift-invert */
+    double eigTol;
+
+    /** maximum number of iterations of a linear solve of the shift-invert */
+    int eigMaxIter;
+
+    /** number of time slices of the parareal integration */
+    int pararealSlices;
+
+    /** maximum number of parareal iterations */
+    int pararealMaxIter;
+
+    /** the parareal iterations stop when the states at the slice boundaries move by less than
+     * this value */
+    double pararealTol;
+
+    /** maximum time step of the coarse propagator */
+    double pararealCoarseDtMax;
+
+    /** maximum variation of the magnetization per step of the coarse propagator */
+    double pararealCoarseDumax;
+
+    /** refresh of the demag potentials of the coarse propagator every that many steps */
+    int pararealCoarseDemagEvery;
+
+    /** meshes of the multi-resolution relaxation, from the coarsest, before the mesh of the
+     * simulation */
+    std::vector<std::string> multiresMeshes;
+
+    /** settings overrides of the runs of a batch, each one read on top of the documents */
+    std::vector<YAML::Node> batchRuns;
+
+    /** number of groups of runs of a batch performed concurrently */
+    int batchConcurrent;
+
+    /** \return the YAML documents read, in the order they were read, so that the settings can be
+     * read again */
+    inline std::vector<YAML::Node> const &getDocuments(void) const { return documents; }
+
+    /** seed the random numbers of the run: drawSeed() then draws from a generator of its own
+     * instead of the global rand(), so that concurrent runs do not depend on their scheduling */
+    inline void setSeed(const unsigned int s /**< [in] */) { randomGen.emplace(s); }
+
+    /** \return a seed for a random number generator of the run, see setSeed() */
+    inline unsigned int drawSeed(void) { return randomGen ? (*randomGen)() : rand(); }
+
+    /** time step controller */
+    step_controller stepController;
+
+    /** tolerance on the local error estimate of the PI time step controller */
+    double errTol;
+
+    /** the time integration stops at equilibrium when the maximum torque \f$ \mu_0 |u \times
+     * H_{\mathrm{eff}}| \f$, in tesla, is below this value, 0 to disable */
+    double stopTorque;
+
+    /** the time integration stops at equilibrium when the maximum speed of the magnetization vmax,
+     * in 1/s, is below this value, 0 to disable */
+    double stopVmax;
+
+    /** the time integration stops at equilibrium when the relative change of the total energy
+     * between two accepted time steps is below this value, 0 to disable */
+    double stopEnergyChange;
+
+    /** number of consecutive accepted time steps meeting all the enabled stopping criteria */
+    int stopSteps;
+
+    /** \return true if at least one stopping criterion on the equilibrium is enabled */
+    bool stopAtEquilibrium() const { return stopTorque > 0 || stopVmax > 0 || stopEnergyChange > 0; }
+
+    /** a node is left out of the linear system when its speed, in 1/s, stays below this value, 0
+     * disables the active set */
+    double activeSetVmax;
+
+    /** and when its torque, in tesla, stays below this value, 0 to ignore the torque */
+    double activeSetTorque;
+
+    /** number of consecutive accepted time steps below the thresholds before a node is left out */
+    int activeSetSteps;
+
+    /** the nodes left out are chosen again every activeSetWindow accepted time steps */
+    int activeSetWindow;
+
+    /** layers of tetrahedrons of solved nodes around the moving nodes */
+    int activeSetHalo;
+
+    /** sub-steps of the fast nodes per time step, 1 disables the multirate time steps */
+    int multirateFactor;
+
+    /** layers of tetrahedrons of sub-stepped nodes around the fast nodes */
+    int multirateHalo;
+
     /** \return index of the region in surface region container  */
     inline int findFacetteRegionIdx(const std::string name /**< [in] */) const
         {
@@ -305,10 +613,20 @@ public:
     inline double getFieldTime(const double t_val) const
         { return (field_time_parser.get_scalar(t_val))/mu0; }
 
+    /** Replace the applied field by a uniform and constant field. field_type becomes `RtoR3`.
+     */
+    void setConstantField(Eigen::Vector3d const &B /**< [in] field in tesla */);
+
+    /** \return true if the applied field is given by three numbers, so that it does not depend on
+     * time */
+    bool isFieldConstant(void) const;
+
 private:
     using MetadataItem = std::pair<std::string, std::string>;  /**< type of userMetadata items */
 
     std::vector<MetadataItem> userMetadata;  /**< user-provided metadata for the output files */
+    std::vector<YAML::Node> documents;       /**< YAML documents read by read() */
+    std::optional<std::mt19937> randomGen;   /**< generator of the seeds, if set by setSeed() */
     int precision;               /**< numeric precision for .sol output text files */
     std::string fileDisplayName; /**< parameters file name : either a yaml file or standard input */
     double _scale;               /**< scaling factor from gmsh files to feellgood */
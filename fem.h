@@ -50,11 +50,6 @@ public:
     /** constructor: call mesh constructor, initialize pts,kdtree and many inner variables */
     inline Fem(Settings const &mySets, timing &t_prm) : msh(mySets)
         {
-        vmax = 0.0;
-        std::fill(E.begin(),E.end(),0);
-        Etot0 = INFINITY;  // avoid "WARNING: energy increased" on first time step
-        Etot = 0.0;
-
         recenter_mem = false;
         if (mySets.recenter)
             {
@@ -102,15 +97,32 @@ public:
             {
             std::cout << "No recentering.\n";
             }
+        reset(mySets, t_prm);
+        }
+
+    /** set the initial magnetization and time of a simulation, and clear the energies */
+    inline void reset(Settings const &mySets /**< [in] */, timing &t_prm /**< [out] */)
+        {
+        vmax = 0.0;
+        std::fill(E.begin(),E.end(),0);
+        Etot0 = INFINITY;  // avoid "WARNING: energy increased" on first time step
+        Etot = 0.0;
 
         if (mySets.restoreFileName == "")
             {
             msh.init_distrib(mySets);
             }
-        else
+        else if (mySets.restoreMeshName == "")
             {
             t_prm.set_t(msh.readSol(mySets.verbose, mySets.restoreFileName));
             }
+        else
+            {
+            Mesh::mesh source(mySets, mySets.restoreMeshName);
+            t_prm.set_t(source.readSol(mySets.verbose, mySets.restoreFileName));
+            msh.interpolate(source);
+            }
+        msh.syncPeriodicNodes();
 
         /* This potentially overrides the initial time set above by msh.readSol(). */
         if (!isnan(mySets.initial_time))
@@ -157,6 +169,13 @@ public:
                                   applied field is time dependant */
                 ,Settings &settings /**< [in] */);
 
+    /** computes the effective field on the nodes, on the NEXT step: the opposite of the gradient
+    of the total energy with respect to the magnetization of each node, divided by its lumped moment
+    \f$ \int J_s a_i \f$. Periodic images get the field of their master */
+    void effectiveField(double const t /**< [in] time in second, for the applied field */,
+                        Settings &settings /**< [in] */,
+                        std::vector<Eigen::Vector3d> &H /**< [out] */) const;
+
     /**
     time evolution : one step in time
     */
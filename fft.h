@@ -0,0 +1,137 @@
+#ifndef fft_h
+#define fft_h
+
+/** \file fft.h
+\brief in place radix-2 fast Fourier transform of complex data, in one and three dimensions. The
+sizes must be powers of two. The three dimensional transform is computed line by line along each
+axis, lines are transformed in parallel.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <numeric>
+#include <vector>
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <execution>
+#pragma GCC diagnostic pop
+
+#include "config.h"
+
+/** \namespace fft
+to grab altogether the fast Fourier transform and the grid based demag solver
+*/
+namespace fft
+    {
+/** \return the smallest power of two greater or equal to n */
+inline int nextPow2(const int n)
+    {
+    int p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+    }
+
+/**
+in place transform of the n = 2^k complex values of a, forward (exp(-2 i pi jk/n)) or inverse
+(exp(+2 i pi jk/n)). The inverse transform is not normalized.
+*/
+inline void transform(std::complex<double> *a, const int n, const bool inverse)
+    {
+    // bit reversal permutation
+    for (int i = 1, j = 0; i < n; i++)
+        {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(a[i], a[j]);
+        }
+    // butterflies
+    for (int len = 2; len <= n; len <<= 1)
+        {
+        const double angle = (inverse ? 2 : -2) * M_PI / len;
+        const std::complex<double> wlen(cos(angle), sin(angle));
+        for (int i = 0; i < n; i += len)
+            {
+            std::complex<double> w(1);
+            for (int j = 0; j < len / 2; j++)
+                {
+                const std::complex<double> u = a[i + j];
+                const std::complex<double> v = a[i + j + len / 2] * w;
+                a[i + j] = u + v;
+                a[i + j + len / 2] = u - v;
+                w *= wlen;
+                }
+            }
+        }
+    }
+
+/** \class grid3d
+complex values on a regular grid of nx*ny*nz points, stored with x running fastest: value (i,j,k)
+is data[(k*ny + j)*nx + i]. All dimensions must be powers of two.
+*/
+class grid3d
+    {
+public:
+    /** constructor, values are initialized to zero */
+    grid3d(const int _nx /**< [in] */, const int _ny /**< [in] */, const int _nz /**< [in] */)
+        : nx(_nx), ny(_ny), nz(_nz), data(_nx * _ny * _nz)
+        {}
+
+    const int nx; /**< number of points along x */
+    const int ny; /**< number of points along y */
+    const int nz; /**< number of points along z */
+
+    /** values */
+    std::vector<std::complex<double>> data;
+
+    /** \return linear index of point (i,j,k) */
+    inline int idx(const int i, const int j, const int k) const { return (k * ny + j) * nx + i; }
+
+    /** forward transform, in place */
+    void forward(void) { transform3d(false); }
+
+    /** inverse transform, in place, normalized: inverse() after forward() is the identity */
+    void inverse(void)
+        {
+        transform3d(true);
+        const double scale = 1.0 / data.size();
+        std::for_each(EXEC_POL, data.begin(), data.end(),
+                      [scale](std::complex<double> &x) { x *= scale; });
+        }
+
+private:
+    /** transforms all the lines of n points, line l starting at start(l), points spaced by
+     * stride */
+    template<class F>
+    void transformLines(const int nbLines, const int n, const int stride, F start, const bool inv)
+        {
+        std::vector<int> lines(nbLines);
+        std::iota(lines.begin(), lines.end(), 0);
+        std::for_each(EXEC_POL, lines.begin(), lines.end(),
+                      [this, n, stride, &start, inv](const int l)
+                      {
+                          thread_local std::vector<std::complex<double>> buf;
+                          buf.resize(n);
+                          std::complex<double> *p = data.data() + start(l);
+                          for (int m = 0; m < n; m++)
+                              buf[m] = p[m * stride];
+                          transform(buf.data(), n, inv);
+                          for (int m = 0; m < n; m++)
+                              p[m * stride] = buf[m];
+                      });
+        }
+
+    /** transform along the three axis */
+    void transform3d(const bool inv)
+        {
+        transformLines(ny * nz, nx, 1, [this](const int l) { return l * nx; }, inv);
+        transformLines(nx * nz, ny, nx,
+                       [this](const int l) { return idx(l % nx, 0, l / nx); }, inv);
+        transformLines(nx * ny, nz, nx * ny, [](const int l) { return l; }, inv);
+        }
+    };
+    }  // namespace fft
+#endif
@@ -0,0 +1,228 @@
+#ifndef FFT_DEMAG_H
+#define FFT_DEMAG_H
+
+/** \file fft_demag.h
+\brief demag field computed on an auxiliary regular grid, particle-particle particle-mesh style. The
+charges on the Gauss points are spread on the nodes of a regular grid with trilinear (cloud in cell)
+weights, the potential on the grid is the convolution of the grid charges with 1/r, computed with
+FFT on a grid padded to twice its size, then interpolated back to the nodes of the mesh with the
+same weights. The short range error of the grid is removed by a sparse near field correction, and
+the analytical corrections of the facettes are kept. It is best suited to compact geometries: the
+cost grows with the volume of the bounding box of the mesh.
+*/
+
+#include <cmath>
+
+#include <eigen3/Eigen/Sparse>
+
+#include "ANN.h"
+#include "demagSolver.h"
+#include "fft.h"
+#include "mesh.h"
+
+namespace fft
+    {
+/** \class solver
+demag solver using a FFT convolution on a regular grid
+*/
+class solver : public demagSolver
+    {
+public:
+    /** constructor, builds the grid, the transform of the Green function and the near field
+     * correction */
+    solver(Mesh::mesh &msh /**< [in] */,
+           std::vector<Tetra::prm> &prmTet /**< [in] */,
+           std::vector<Facette::prm> &prmFac /**< [in] */,
+           const int nbCells /**< [in] number of grid cells along the largest dimension */,
+           const double nearFieldRadius /**< [in] radius of the near field correction, in cells */)
+        : demagSolver(msh, prmTet, prmFac), h(msh.l.maxCoeff() / nbCells),
+          origin(msh.c - 0.5 * msh.l - Eigen::Vector3d::Constant(h)),
+          n((msh.l / h).array().ceil().cast<int>() + 3),
+          G(nextPow2(2 * n.x()), nextPow2(2 * n.y()), nextPow2(2 * n.z())),
+          rho(G.nx, G.ny, G.nz), pot(NOD)
+        {
+        buildGreen();
+        std::vector<Eigen::Vector3d> src = sourcePositions(msh);
+        srcStencil.resize(src.size());
+        for (unsigned int j = 0; j < src.size(); j++)
+            srcStencil[j] = stencil(src[j]);
+        nodeStencil.resize(NOD);
+        for (int i = 0; i < NOD; i++)
+            nodeStencil[i] = stencil(msh.getNode_p(i));
+        buildNearCorrection(msh, src, nearFieldRadius * h);
+        }
+
+    /** print some informations on the solver */
+    void infos(void) const override
+        {
+        std::cout << "  fft grid: " << n.x() << "x" << n.y() << "x" << n.z() << " nodes, padded to "
+                  << G.nx << "x" << G.ny << "x" << G.nz << ", cell size " << h << '\n';
+        std::cout << "  near field corrections: " << nearCorr.nonZeros() << '\n';
+        }
+
+private:
+    /** \struct cic
+    trilinear weights of a point: index in the padded grid of the lower corner of its cell, and
+    fractional position in the cell */
+    struct cic
+        {
+        int i, j, k;       /**< lower corner of the cell */
+        Eigen::Vector3d f; /**< fractional position in the cell, in [0,1[^3 */
+
+        /** \return weight of the corner (a,b,c) of the cell, a,b,c in {0,1} */
+        inline double w(const int a, const int b, const int c) const
+            {
+            return (a ? f.x() : 1 - f.x()) * (b ? f.y() : 1 - f.y()) * (c ? f.z() : 1 - f.z());
+            }
+        };
+
+    const double h;               /**< grid cell size */
+    const Eigen::Vector3d origin; /**< position of grid node (0,0,0) */
+    const Eigen::Vector3i n;      /**< number of grid nodes covering the mesh, along each axis */
+
+    grid3d G;   /**< transform of the Green function on the padded grid */
+    grid3d rho; /**< grid charges, then potentials */
+
+    std::vector<cic> srcStencil;  /**< weights of the sources */
+    std::vector<cic> nodeStencil; /**< weights of the nodes */
+
+    /** near field correction (exact interaction minus grid interaction), acting on srcDen */
+    Eigen::SparseMatrix<double, Eigen::RowMajor> nearCorr;
+
+    std::vector<double> pot; /**< potentials on the nodes, without corrections */
+
+    /** \return the trilinear weights of p */
+    cic stencil(Eigen::Vector3d const &p) const
+        {
+        Eigen::Vector3d s = (p - origin) / h;
+        cic c;
+        c.i = static_cast<int>(floor(s.x()));
+        c.j = static_cast<int>(floor(s.y()));
+        c.k = static_cast<int>(floor(s.z()));
+        c.f = s - Eigen::Vector3d(c.i, c.j, c.k);
+        return c;
+        }
+
+    /** \return the Green function between two grid nodes distant of (di,dj,dk) cells. On a
+     * single node it is the mean value of 1/r on a cube of edge h */
+    inline double green(const int di, const int dj, const int dk) const
+        {
+        if (di == 0 && dj == 0 && dk == 0) return 2.3800772 / h;
+        return 1.0 / (h * sqrt(static_cast<double>(di * di + dj * dj + dk * dk)));
+        }
+
+    /** fills G with the Green function, wrapped around for the circular convolution, and
+     * transforms it */
+    void buildGreen(void)
+        {
+        for (int k = 0; k < G.nz; k++)
+            for (int j = 0; j < G.ny; j++)
+                for (int i = 0; i < G.nx; i++)
+                    {
+                    const int di = (i <= G.nx / 2) ? i : i - G.nx;
+                    const int dj = (j <= G.ny / 2) ? j : j - G.ny;
+                    const int dk = (k <= G.nz / 2) ? k : k - G.nz;
+                    G.data[G.idx(i, j, k)] = green(di, dj, dk);
+                    }
+        G.forward();
+        }
+
+    /** \return the potential computed on the grid at t due to a unit charge at s */
+    double gridInteraction(cic const &t, cic const &s) const
+        {
+        double val(0);
+        for (int a = 0; a < 2; a++)
+            for (int b = 0; b < 2; b++)
+                for (int c = 0; c < 2; c++)
+                    for (int a2 = 0; a2 < 2; a2++)
+                        for (int b2 = 0; b2 < 2; b2++)
+                            for (int c2 = 0; c2 < 2; c2++)
+                                val += t.w(a, b, c) * s.w(a2, b2, c2)
+                                       * green(t.i + a - s.i - a2, t.j + b - s.j - b2,
+                                               t.k + c - s.k - c2);
+        return val;
+        }
+
+    /** builds the sparse near field correction matrix, the nodes closer than radius to a source
+     * are searched with ANN */
+    void buildNearCorrection(Mesh::mesh const &msh, std::vector<Eigen::Vector3d> const &src,
+                             const double radius)
+        {
+        ANNpointArray pts = annAllocPts(NOD, Nodes::DIM);
+        if (!pts)
+            {
+            std::cout << "ANN memory error while allocating points" << std::endl;
+            SYSTEM_ERROR;
+            }
+        for (int i = 0; i < NOD; i++)
+            {
+            pts[i][0] = msh.getNode_p(i).x();
+            pts[i][1] = msh.getNode_p(i).y();
+            pts[i][2] = msh.getNode_p(i).z();
+            }
+        ANNkd_tree kdtree(pts, NOD, Nodes::DIM);
+
+        std::vector<Eigen::Triplet<double>> triplets;
+        std::vector<ANNidx> nnIdx;
+        const ANNdist sqRad = Nodes::sq(radius);
+        for (unsigned int j = 0; j < src.size(); j++)
+            {
+            ANNcoord queryPt[Nodes::DIM] = {src[j].x(), src[j].y(), src[j].z()};
+            const int nb = kdtree.annkFRSearch(queryPt, sqRad, 0);
+            nnIdx.resize(nb);
+            kdtree.annkFRSearch(queryPt, sqRad, nb, nnIdx.data());
+            for (int i : nnIdx)
+                {
+                const double r = (msh.getNode_p(i) - src[j]).norm();
+                triplets.push_back(Eigen::Triplet<double>(
+                        i, j, 1.0 / r - gridInteraction(nodeStencil[i], srcStencil[j])));
+                }
+            }
+        nearCorr.resize(NOD, src.size());
+        nearCorr.setFromTriplets(triplets.begin(), triplets.end());
+        annDeallocPts(pts);
+        }
+
+    /**
+    computes the demag field, with (getter  = u,setter = phi) or (getter = v,setter = phi_v)
+    */
+    void demag(std::function<const Eigen::Vector3d(Nodes::Node)> getter,
+               std::function<void(Nodes::Node &, const double)> setter, Mesh::mesh &msh) override
+        {
+        calc_charges(getter, msh);
+
+        std::fill(rho.data.begin(), rho.data.end(), 0);
+        for (unsigned int j = 0; j < srcStencil.size(); j++)
+            {
+            cic const &s = srcStencil[j];
+            for (int a = 0; a < 2; a++)
+                for (int b = 0; b < 2; b++)
+                    for (int c = 0; c < 2; c++)
+                        rho.data[rho.idx(s.i + a, s.j + b, s.k + c)] += s.w(a, b, c) * srcDen[j];
+            }
+        rho.forward();
+        std::transform(EXEC_POL, rho.data.begin(), rho.data.end(), G.data.begin(),
+                       rho.data.begin(), std::multiplies<std::complex<double>>());
+        rho.inverse();
+
+        Eigen::VectorXd nearPot =
+                nearCorr * Eigen::Map<const Eigen::VectorXd>(srcDen.data(), srcDen.size());
+        for (int i = 0; i < NOD; i++)
+            {
+            cic const &t = nodeStencil[i];
+            double val(0);
+            for (int a = 0; a < 2; a++)
+                for (int b = 0; b < 2; b++)
+                    for (int c = 0; c < 2; c++)
+                        val += t.w(a, b, c) * rho.data[rho.idx(t.i + a, t.j + b, t.k + c)].real();
+            pot[i] = val + nearPot(i);
+            }
+        for (int i = 0; i < NOD; i++)
+            {
+            msh.set(i, setter, (pot[i] + corr[i]) / (4 * M_PI));
+            }
+        }
+    };  // end class solver
+
+    }  // namespace fft
+#endif
@@ -9,11 +9,26 @@ the fast multipole algorithm, and to compute the demag field.
 #include "Components/FParticleType.hpp"
 #include "Components/FTypedLeaf.hpp"
 #include "Containers/FOctree.hpp"
+#include "Core/FFmmAlgorithmPeriodic.hpp"
 #include "Core/FFmmAlgorithmThreadTsm.hpp"
 #include "Kernels/P2P/FP2PParticleContainerIndexed.hpp"
+#include "Kernels/Chebyshev/FChebCell.hpp"
+#include "Kernels/Chebyshev/FChebSymKernel.hpp"
+#include "Kernels/Interpolation/FInterpMatrixKernel.hpp"
 #include "Kernels/Rotation/FRotationCell.hpp"
 #include "Kernels/Rotation/FRotationKernel.hpp"
+#include "Kernels/Spherical/FSphericalCell.hpp"
+#include "Kernels/Spherical/FSphericalKernel.hpp"
+#include "Kernels/Uniform/FUnifCell.hpp"
+#include "Kernels/Uniform/FUnifKernel.hpp"
 
+#include <memory>
+#include <numeric>
+
+#include <eigen3/Eigen/Sparse>
+
+#include "ANN.h"
+#include "demagSolver.h"
 #include "mesh.h"
 
 /** \namespace scal_fmm
@@ -23,97 +38,368 @@ to grab altogether the templates and functions using scalfmm for the computation
 namespace scal_fmm
     {
 const int P = 9;              /**< truncation of the spherical harmonics series */
+const int ORDER = 6;          /**< order of the interpolation kernels (Chebyshev and uniform) */
 const int NbLevels = 6;       /**< number of levels in the tree */
 const int SizeSubLevels = 3;  /**< size of the sub levels  */
 
+#if ENABLE_FMM_FLOAT
+typedef float FReal; /**< parameter of scalfmm templates, the fast multipole algorithm runs in single
+                        precision; charges and potentials are converted at the interface */
+#else
 typedef double FReal; /**< parameter of scalfmm templates, all computations are made in double precision */
+#endif
+
+const double boxWidth = 2.01; /**< bounding box max dimension */
+
+/** center of the bounding box */
+template<typename Real>
+const FPoint<Real> boxCenter(0., 0., 0.);
+
+/** \struct kernelTypes
+types of scalfmm common to all the kernels, for the floating point type Real of the fast multipole
+algorithm
+*/
+template<typename Real>
+struct kernelTypes
+    {
+    typedef Real RealType; /**< floating point type of the fast multipole algorithm */
+
+    typedef FP2PParticleContainerIndexed<Real>
+            ContainerClass; /**< convenient typedef for the definition of container for scalfmm */
 
-typedef FTypedRotationCell<FReal, P>
-        CellClass; /**< convenient typedef for the definition of cell type in scalfmm  */
+    typedef FTypedLeaf<Real, ContainerClass>
+            LeafClass; /**< convenient typedef for the definition of leaf for scalfmm  */
 
-typedef FP2PParticleContainerIndexed<FReal>
-        ContainerClass; /**< convenient typedef for the definition of container for scalfmm */
+    typedef FInterpMatrixKernelR<Real>
+            MatrixKernelClass; /**< 1/r kernel evaluated by the interpolation kernels */
+    };
 
-typedef FTypedLeaf<FReal, ContainerClass>
-        LeafClass; /**< convenient typedef for the definition of leaf for scalfmm  */
+/** \struct rotationKernel
+kernel traits: spherical harmonics expansions with rotation based translations, truncated at P
+*/
+template<typename Real = FReal>
+struct rotationKernel : kernelTypes<Real>
+    {
+    typedef typename kernelTypes<Real>::ContainerClass ContainerClass; /**< container type */
+    typedef FTypedRotationCell<Real, P> CellClass; /**< cell type */
+    typedef FRotationKernel<Real, CellClass, ContainerClass, P> KernelClass; /**< kernel type */
+
+    /** name in the settings */
+    static constexpr const char *name = "rotation";
+
+    /** \return a new kernel */
+    static KernelClass *make(const int levels = NbLevels, const Real width = boxWidth,
+                             FPoint<Real> const &center = boxCenter<Real>)
+        {
+        return new KernelClass(levels, width, center);
+        }
+    };
+
+/** \struct sphericalKernel
+kernel traits: spherical harmonics expansions (classical translations), truncated at P
+*/
+template<typename Real = FReal>
+struct sphericalKernel : kernelTypes<Real>
+    {
+    typedef typename kernelTypes<Real>::ContainerClass ContainerClass; /**< container type */
+    typedef FTypedSphericalCell<Real> CellClass; /**< cell type */
+    typedef FSphericalKernel<Real, CellClass, ContainerClass> KernelClass; /**< kernel type */
 
-typedef FOctree<FReal, CellClass, ContainerClass, LeafClass>
-        OctreeClass; /**< convenient typedef for the definition of the octree for scalfmm */
+    /** name in the settings */
+    static constexpr const char *name = "spherical";
 
-typedef FRotationKernel<FReal, CellClass, ContainerClass, P>
-        KernelClass; /**< convenient typedef for the kernel for scalfmm */
+    /** \return a new kernel, the size of the expansions of the cells has to be initialized first */
+    static KernelClass *make(const int levels = NbLevels, const Real width = boxWidth,
+                             FPoint<Real> const &center = boxCenter<Real>)
+        {
+        CellClass::Init(P);
+        return new KernelClass(P, levels, width, center);
+        }
+    };
 
-typedef FFmmAlgorithmThreadTsm<OctreeClass, CellClass, ContainerClass, KernelClass, LeafClass>
-        FmmClass; /**< convenient typedef for handling altogether the differents scalfmm object
-                     templates used in feellgood  */
+/** \struct chebyshevKernel
+kernel traits: Chebyshev interpolation of order ORDER, with symmetries
+*/
+template<typename Real = FReal>
+struct chebyshevKernel : kernelTypes<Real>
+    {
+    typedef typename kernelTypes<Real>::ContainerClass ContainerClass; /**< container type */
+    typedef typename kernelTypes<Real>::MatrixKernelClass MatrixKernelClass; /**< 1/r kernel */
+    typedef FTypedChebCell<Real, ORDER> CellClass; /**< cell type */
+    typedef FChebSymKernel<Real, CellClass, ContainerClass, MatrixKernelClass, ORDER>
+            KernelClass; /**< kernel type */
+
+    /** name in the settings */
+    static constexpr const char *name = "chebyshev";
+
+    /** \return a new kernel */
+    static KernelClass *make(const int levels = NbLevels, const Real width = boxWidth,
+                             FPoint<Real> const &center = boxCenter<Real>)
+        {
+        static const MatrixKernelClass matrixKernel;
+        return new KernelClass(levels, width, center, &matrixKernel);
+        }
+    };
 
-const double boxWidth = 2.01;              /**< bounding box max dimension */
-const FPoint<FReal> boxCenter(0., 0., 0.); /**< center of the bounding box */
+/** \struct uniformKernel
+kernel traits: Lagrange interpolation of order ORDER on uniform grids, translations with FFT
+*/
+template<typename Real = FReal>
+struct uniformKernel : kernelTypes<Real>
+    {
+    typedef typename kernelTypes<Real>::ContainerClass ContainerClass; /**< container type */
+    typedef typename kernelTypes<Real>::MatrixKernelClass MatrixKernelClass; /**< 1/r kernel */
+    typedef FTypedUnifCell<Real, ORDER> CellClass; /**< cell type */
+    typedef FUnifKernel<Real, CellClass, ContainerClass, MatrixKernelClass, ORDER>
+            KernelClass; /**< kernel type */
+
+    /** name in the settings */
+    static constexpr const char *name = "uniform";
+
+    /** \return a new kernel */
+    static KernelClass *make(const int levels = NbLevels, const Real width = boxWidth,
+                             FPoint<Real> const &center = boxCenter<Real>)
+        {
+        static const MatrixKernelClass matrixKernel;
+        return new KernelClass(levels, width, center, &matrixKernel);
+        }
+    };
 
 /** \class fmm
 to initialize a tree and a kernel for the computation of the demagnetizing field, and launch the
-computation easily with calc_demag public member
+computation easily with calc_demag public member. Template parameter Kernel is one of the kernel
+traits rotationKernel, sphericalKernel, chebyshevKernel or uniformKernel, whose template parameter
+is the floating point type of the fast multipole algorithm, FReal by default
 */
-class fmm
+template<class Kernel>
+class fmm : public demagSolver
     {
+    typedef typename Kernel::RealType
+            Real; /**< floating point type of the fast multipole algorithm */
+
+    typedef typename Kernel::ContainerClass
+            ContainerClass; /**< convenient typedef for the definition of container for scalfmm */
+
+    typedef typename Kernel::LeafClass
+            LeafClass; /**< convenient typedef for the definition of leaf for scalfmm  */
+
+    typedef typename Kernel::CellClass
+            CellClass; /**< convenient typedef for the definition of cell type in scalfmm  */
+
+    typedef FOctree<Real, CellClass, ContainerClass, LeafClass>
+            OctreeClass; /**< convenient typedef for the definition of the octree for scalfmm */
+
+    typedef typename Kernel::KernelClass
+            KernelClass; /**< convenient typedef for the kernel for scalfmm */
+
+    typedef FFmmAlgorithmThreadTsm<OctreeClass, CellClass, ContainerClass, KernelClass, LeafClass>
+            FmmClass; /**< convenient typedef for handling altogether the differents scalfmm object
+                         templates used in feellgood  */
+
+    typedef FFmmAlgorithmPeriodic<Real, OctreeClass, CellClass, ContainerClass, KernelClass, LeafClass>
+            PeriodicFmmClass; /**< fast multipole algorithm with periodic boundary conditions */
+
 public:
-    /** constructor, initialize memory for tree, kernel, sources corrections, initialize all sources
+    /** constructor, initialize memory for tree, kernel, sources corrections, initialize all sources.
+     If nearFieldRadius is positive, far field source compression is on: each element is inserted in
+     the tree as a single source carrying its total charge, located at its barycenter; the exact
+     point charges of the element are restored by a sparse correction for the nodes closer to its
+     barycenter than nearFieldRadius times its diameter.
+     The probes are inserted as extra targets of unit charge: the kernels compute the potential and
+     its gradient on them, the field is read from the forces. The octree is enlarged to contain
+     them.
+     If the mesh is periodic, the box of the octree is the periodic cell, only the nodes holding a
+     degree of freedom are targets, and the periodic algorithm sums imageShells levels of images.
      */
     inline fmm(Mesh::mesh &msh /**< [in] */,
                std::vector<Tetra::prm> & prmTet /**< [in] */,
                std::vector<Facette::prm> & prmFac /**< [in] */,
-               const int ScalfmmNbThreads /**< [in] */)
-        : prmTetra(prmTet), prmFacette(prmFac), NOD(msh.getNbNodes()),
-          tree(NbLevels, SizeSubLevels, boxWidth, boxCenter), kernels(NbLevels, boxWidth, boxCenter)
+               const int ScalfmmNbThreads /**< [in] */,
+               const double nearFieldRadius = 0 /**< [in] */,
+               std::vector<Eigen::Vector3d> const &probes = {} /**< [in] probe positions */,
+               const int imageShells = 3 /**< [in] levels of periodic images, if periodic */)
+        : demagSolver(msh, prmTet, prmFac), compressed(nearFieldRadius > 0),
+          nbTets(msh.getNbTets()), kernels(Kernel::make()),
+          tree(NbLevels, SizeSubLevels, boxWidth, boxCenter<Real>)
         {
         omp_set_num_threads(ScalfmmNbThreads);
-        norm = 2. / msh.l.maxCoeff();
-
-        FSize idxPart = 0;
-        for (idxPart = 0; idxPart < NOD; ++idxPart)
+        double extent = msh.l.maxCoeff();
+        for (Eigen::Vector3d const &p : probes)
+            extent = std::max(extent, 2 * (p - msh.c).cwiseAbs().maxCoeff());
+        norm = 2. / extent;
+        periodicDirs = periodicDirections(msh);
+        if (periodicDirs)
+            norm = boxWidth / period(msh);
+        probePhi.resize(probes.size());
+        probeH.resize(probes.size());
+        probeGrad.resize(probes.size());
+
+        std::vector<Eigen::Vector3d> targets = nodePositions(msh);
+        targets.insert(targets.end(), probes.begin(), probes.end());
+        for (int i = 0; i < NOD; ++i)
             {
-            Eigen::Vector3d pTarget = norm*(msh.getNode_p(idxPart) - msh.c);
-            tree.insert(FPoint<FReal>(pTarget.x(), pTarget.y(), pTarget.z()),
-                        FParticleType::FParticleTypeTarget, idxPart);
+            if (msh.getMaster(i) != i) continue;
+            tree.insert(treePoint(targets[i], msh.c), FParticleType::FParticleTypeTarget, i);
             }
+        for (unsigned int i = NOD; i < targets.size(); ++i)
+            tree.insert(treePoint(targets[i], msh.c), FParticleType::FParticleTypeTarget, i, Real(1));
+        FSize idxPart = NOD;
 
-        insertCharges<Tetra::Tet, Tetra::NPI>(msh.tet, idxPart, msh.c);
-        insertCharges<Facette::Fac, Facette::NPI>(msh.fac, idxPart, msh.c);
-
-        srcDen.resize( msh.getNbFacs()*Facette::NPI + msh.getNbTets()*Tetra::NPI );
-        corr.resize(NOD);
+        if (compressed)
+            {
+            insertBarycenters<Tetra::Tet, Tetra::N>(msh, msh.tet, idxPart);
+            insertBarycenters<Facette::Fac, Facette::N>(msh, msh.fac, idxPart);
+            aggDen.resize(msh.getNbTets() + msh.getNbFacs());
+            buildNearCorrection(msh, targets, nearFieldRadius);
+            }
+        else
+            {
+            insertCharges<Tetra::Tet, Tetra::NPI>(msh.tet, idxPart, msh.c);
+            insertCharges<Facette::Fac, Facette::NPI>(msh.fac, idxPart, msh.c);
+            }
+        cacheTree(imageShells);
+        pot.resize(targets.size());
         }
 
-    /**
-    launch the calculation of the demag field with second order corrections
-    */
-    void calc_demag(Mesh::mesh &msh /**< [in] */)
+    /** print some informations on the solver */
+    void infos(void) const override
         {
-        demag(Nodes::get_u<Nodes::NEXT>, Nodes::set_phi, msh);
-        demag(Nodes::get_v<Nodes::NEXT>, Nodes::set_phiv, msh);
+        std::cout << "  fmm kernel: " << Kernel::name << "\n";
+        if (compressed)
+            std::cout << "  source compression: " << nearCorr.nonZeros()
+                      << " near field corrections\n";
+        if (!probePhi.empty())
+            std::cout << "  probes: " << probePhi.size() << '\n';
+        if (periodicDirs)
+            std::cout << "  periodic repetitions of the cell: "
+                      << static_cast<PeriodicFmmClass *>(algo.get())->theoricalRepetition() << '\n';
         }
 
-    /** sources */
-    std::vector<double> srcDen;
-    
-    /** corrections associated to the nodes, contributions only due to the facettes */
-    std::vector<double> corr;
+private:
+    const bool compressed; /**< true if far field source compression is on */
+
+    const int nbTets; /**< number of tetrahedrons */
 
-    /** all volume region parameters for the tetraedrons */
-    std::vector<Tetra::prm> prmTetra;
+    /** total charge of each element, tetrahedrons first then facettes, if compressed */
+    std::vector<double> aggDen;
 
-    /** all surface region parameters for the facettes */
-    std::vector<Facette::prm> prmFacette;
+    /** near field correction (exact point charges minus aggregated charge), acting on srcDen */
+    Eigen::SparseMatrix<double, Eigen::RowMajor> nearCorr;
 
-private:
-    const int NOD; /**< number of nodes */
+    /** potentials due to the near field correction */
+    Eigen::VectorXd nearPot;
+
+    /** gradients of the near field correction on the probes along x, y and z, acting on srcDen */
+    Eigen::SparseMatrix<double, Eigen::RowMajor> nearGrad[Nodes::DIM];
+
+    /** kernel initialized by constructor, before the tree since some kernels initialize the cells */
+    std::unique_ptr<KernelClass> kernels;
 
     OctreeClass tree;    /**< tree initialized by constructor */
 
-    KernelClass kernels; /**< kernel initialized by constructor */
+    /** algorithm, built once the tree is filled, its per thread copies of the kernel are reused by
+     * all calls to demag. It is a PeriodicFmmClass if the mesh is periodic, a FmmClass otherwise */
+    std::unique_ptr<FAbstractAlgorithm> algo;
+
+    /** periodic directions of the mesh, as a combination of the scalfmm PeriodicCondition flags */
+    int periodicDirs;
+
+    /** \struct leafData
+    a leaf of the tree with the offsets of its particles in srcIdx and tgtIdx */
+    struct leafData
+        {
+        LeafClass *leaf; /**< leaf of the tree */
+        int srcBegin;    /**< offset of the first source of the leaf in srcIdx */
+        int tgtBegin;    /**< offset of the first target of the leaf in tgtIdx */
+        };
+
+    std::vector<leafData> leaves; /**< all leaves of the tree */
+
+    std::vector<CellClass *> cells; /**< all cells of the tree, at all levels */
+
+    std::vector<int> srcIdx; /**< index in den of the sources, in leaf order */
+
+    std::vector<int> tgtIdx; /**< index of the target nodes, in leaf order */
+
+    std::vector<double> pot; /**< potentials on the nodes then on the probes */
+
+    /** gradients of the potential on the probes, from the forces computed by the kernels */
+    std::vector<Eigen::Vector3d> probeGrad;
+
+    std::vector<double> masterCorr; /**< corrections summed on the nodes holding a degree of freedom */
 
     double norm; /**< normalization coefficient */
 
+    /** \return the periodic directions of the mesh as scalfmm PeriodicCondition flags */
+    static int periodicDirections(Mesh::mesh const &msh)
+        {
+        int dirs(0);
+        if (msh.isPeriodic(Nodes::IDX_X)) dirs |= DirX;
+        if (msh.isPeriodic(Nodes::IDX_Y)) dirs |= DirY;
+        if (msh.isPeriodic(Nodes::IDX_Z)) dirs |= DirZ;
+        return dirs;
+        }
+
+    /** \return the period of a periodic mesh. The box of the octree is a cube, so all the periodic
+     * directions must have the same period, and the mesh must fit in it along the others */
+    static double period(Mesh::mesh const &msh)
+        {
+        double T(0);
+        for (int d = 0; d < Nodes::DIM; d++)
+            if (msh.isPeriodic(static_cast<Nodes::index>(d))) T = std::max(T, msh.l(d));
+        for (int d = 0; d < Nodes::DIM; d++)
+            {
+            const bool p = msh.isPeriodic(static_cast<Nodes::index>(d));
+            if ((p && fabs(msh.l(d) - T) > 1e-6 * T) || (!p && msh.l(d) > T))
+                {
+                std::cout << "Fatal Error: the periodic fmm needs the same period along all the "
+                             "periodic directions, and a mesh fitting in a cube of this size\n";
+                exit(1);
+                }
+            }
+        return T;
+        }
+
+    /** \return the position p in the normalized frame of the octree, clamped to the box: the nodes
+     * of the faces of a periodic cell lie on its boundary */
+    FPoint<Real> treePoint(Eigen::Vector3d const &p, Eigen::Ref<const Eigen::Vector3d> const c) const
+        {
+        Eigen::Vector3d q = (norm * (p - c)).cwiseMax(-0.5 * boxWidth).cwiseMin(0.5 * boxWidth);
+        return FPoint<Real>(static_cast<Real>(q.x()), static_cast<Real>(q.y()),
+                             static_cast<Real>(q.z()));
+        }
+
+    /** stores the leaves and cells of the tree and the particle indices in leaf order, so that
+     * demag does not have to walk the octree, then builds the algorithm. The periodic algorithm
+     * extends the tree above its root, its kernel is rebuilt on the extended tree */
+    void cacheTree(const int imageShells /**< [in] levels of periodic images */)
+        {
+        tree.forEachLeaf(
+                [this](LeafClass *leaf)
+                {
+                    leaves.push_back({leaf, static_cast<int>(srcIdx.size()),
+                                      static_cast<int>(tgtIdx.size())});
+                    const auto &srcIndexes = leaf->getSrc()->getIndexes();
+                    for (int idxPart = 0; idxPart < leaf->getSrc()->getNbParticles(); ++idxPart)
+                        srcIdx.push_back(srcIndexes[idxPart] - NOD);
+                    const auto &tgtIndexes = leaf->getTargets()->getIndexes();
+                    for (int idxPart = 0; idxPart < leaf->getTargets()->getNbParticles(); ++idxPart)
+                        tgtIdx.push_back(tgtIndexes[idxPart]);
+                });
+        tree.forEachCell([this](CellClass *cell) { cells.push_back(cell); });
+        if (periodicDirs)
+            {
+            auto periodicAlgo = std::make_unique<PeriodicFmmClass>(&tree, imageShells, periodicDirs);
+            kernels.reset(Kernel::make(periodicAlgo->extendedTreeHeight(),
+                                       periodicAlgo->extendedBoxWidth(),
+                                       periodicAlgo->extendedBoxCenter()));
+            periodicAlgo->setKernel(kernels.get());
+            algo = std::move(periodicAlgo);
+            }
+        else
+            algo = std::make_unique<FmmClass>(&tree, kernels.get());
+        }
+
     /**
     function template to insert volume or surface charges in tree for demag computation. class T is
     Tet or Fac, it must have getPtGauss() method, second template parameter is NPI of the namespace
@@ -130,74 +416,263 @@ private:
 
                           for (int j = 0; j < NPI; j++, idx++)
                               {
-                              double x = norm*(gauss(0,j) - c.x());
-                              double y = norm*(gauss(1,j) - c.y());
-                              double z = norm*(gauss(2,j) - c.z());
-                              tree.insert(FPoint<FReal>(x,y,z), FParticleType::FParticleTypeSource, idx, 0.0);
+                              tree.insert(treePoint(gauss.col(j), c),
+                                          FParticleType::FParticleTypeSource, idx, Real(0));
                               }
                       });  // end for_each
         }
 
-    /** computes all charges from tetraedrons and facettes for the demag field to feed a tree in the fast multipole algo (scalfmm)
-     */
-    void calc_charges(std::function<const Eigen::Vector3d(Nodes::Node)> getter, Mesh::mesh &msh)
+    /** barycenter of the vertices of an element */
+    template<class T, const int N>
+    static Eigen::Vector3d barycenter(Mesh::mesh const &msh, T const &elem)
         {
-        int nsrc(0);
-        std::fill(srcDen.begin(),srcDen.end(),0);
-
-        std::for_each(msh.tet.begin(), msh.tet.end(),
-                      [this, getter, &nsrc](Tetra::Tet const &tet)
-                          { tet.charges(prmTetra[tet.idxPrm], getter, srcDen, nsrc); });
-        std::fill(corr.begin(),corr.end(),0);
-        std::for_each(msh.fac.begin(), msh.fac.end(),
-                      [this, getter, &nsrc](Facette::Fac const &fac)
-                          { fac.charges(prmFacette[fac.idxPrm], getter, srcDen, nsrc, corr); });
+        Eigen::Vector3d g = Eigen::Vector3d::Zero();
+        for (int k = 0; k < N; k++)
+            g += msh.getNode_p(elem.ind[k]);
+        return g / N;
         }
 
     /**
-    computes the demag field, with (getter  = u,setter = phi) or (getter = v,setter = phi_v)
+    function template to insert one source per element at its barycenter, for far field source
+    compression. class T is Tet or Fac, second template parameter is N of the namespace containing
+    class T
     */
-    void demag(std::function<const Eigen::Vector3d(Nodes::Node)> getter,
-               std::function<void(Nodes::Node &, const double)> setter, Mesh::mesh &msh)
+    template<class T, const int N>
+    void insertBarycenters(Mesh::mesh const &msh, std::vector<T> const &container, FSize &idx)
         {
-        FmmClass algo(&tree, &kernels);
-        calc_charges(getter, msh);
+        for (T const &elem : container)
+            {
+            tree.insert(treePoint(barycenter<T, N>(msh, elem), msh.c),
+                        FParticleType::FParticleTypeSource, idx++, Real(0));
+            }
+        }
 
-        // reset potentials and forces - physicalValues[idxPart] = Q
-        tree.forEachLeaf(
-                [this](LeafClass *leaf)
+    /** builds the sparse near field correction matrices, targets (nodes then probes) are searched
+     * with ANN within radius times the diameter of each element around its barycenter */
+    void buildNearCorrection(Mesh::mesh const &msh, std::vector<Eigen::Vector3d> const &targets,
+                             const double radius)
+        {
+        const int nbTargets = targets.size();
+        ANNpointArray pts = annAllocPts(nbTargets, Nodes::DIM);
+        if (!pts)
+            {
+            std::cout << "ANN memory error while allocating points" << std::endl;
+            SYSTEM_ERROR;
+            }
+        for (int i = 0; i < nbTargets; i++)
+            {
+            pts[i][0] = targets[i].x();
+            pts[i][1] = targets[i].y();
+            pts[i][2] = targets[i].z();
+            }
+        ANNkd_tree kdtree(pts, nbTargets, Nodes::DIM);
+
+        std::vector<Eigen::Triplet<double>> triplets, gradTriplets[Nodes::DIM];
+        int nsrc(0);
+        addNearCorrections<Tetra::Tet, Tetra::N, Tetra::NPI>(msh, msh.tet, targets, kdtree, radius,
+                                                             nsrc, triplets, gradTriplets);
+        addNearCorrections<Facette::Fac, Facette::N, Facette::NPI>(msh, msh.fac, targets, kdtree,
+                                                                   radius, nsrc, triplets,
+                                                                   gradTriplets);
+        nearCorr.resize(nbTargets, srcDen.size());
+        nearCorr.setFromTriplets(triplets.begin(), triplets.end());
+        for (int d = 0; d < Nodes::DIM; d++)
+            {
+            nearGrad[d].resize(nbTargets - NOD, srcDen.size());
+            nearGrad[d].setFromTriplets(gradTriplets[d].begin(), gradTriplets[d].end());
+            }
+        annDeallocPts(pts);
+        }
+
+    /** adds to triplets the near field corrections of the elements of container, and to
+     * gradTriplets the gradients of these corrections on the probes, nsrc is the index in srcDen of
+     * the first Gauss point of the first element */
+    template<class T, const int N, const int NPI>
+    void addNearCorrections(Mesh::mesh const &msh, std::vector<T> const &container,
+                            std::vector<Eigen::Vector3d> const &targets, ANNkd_tree &kdtree,
+                            const double radius, int &nsrc,
+                            std::vector<Eigen::Triplet<double>> &triplets,
+                            std::vector<Eigen::Triplet<double>> gradTriplets[Nodes::DIM])
+        {
+        std::vector<ANNidx> nnIdx;
+        for (T const &elem : container)
+            {
+            Eigen::Vector3d g = barycenter<T, N>(msh, elem);
+            double diam(0);
+            for (int k = 0; k < N; k++)
+                diam = std::max(diam, 2 * (msh.getNode_p(elem.ind[k]) - g).norm());
+            const ANNdist sqRad = Nodes::sq(radius * diam);
+            ANNcoord queryPt[Nodes::DIM] = {g.x(), g.y(), g.z()};
+
+            const int nb = kdtree.annkFRSearch(queryPt, sqRad, 0);
+            nnIdx.resize(nb);
+            kdtree.annkFRSearch(queryPt, sqRad, nb, nnIdx.data());
+
+            Eigen::Matrix<double, Nodes::DIM, NPI> gauss;
+            elem.getPtGauss(gauss);
+            for (int i : nnIdx)
                 {
-                    const int nbParticlesInLeaf = leaf->getSrc()->getNbParticles();
-                    const auto &indexes = leaf->getSrc()->getIndexes();
-                    FReal *const physicalValues = leaf->getSrc()->getPhysicalValues();
-                    for (int idxPart = 0; idxPart < nbParticlesInLeaf; ++idxPart)
+                Eigen::Vector3d const &p = targets[i];
+                const double inv_dist = 1.0 / (p - g).norm();
+                for (int j = 0; j < NPI; j++)
+                    {
+                    triplets.push_back(
+                            Eigen::Triplet<double>(i, nsrc + j, 1.0 / (p - gauss.col(j)).norm() - inv_dist));
+                    if (i >= NOD)
                         {
-                        physicalValues[idxPart] = srcDen[indexes[idxPart] - NOD];
+                        // gradient of 1/|p - x| with respect to p is -(p - x)/|p - x|^3
+                        Eigen::Vector3d r = p - gauss.col(j);
+                        Eigen::Vector3d grad = (p - g) * inv_dist * inv_dist * inv_dist
+                                               - r / (r.norm() * r.squaredNorm());
+                        for (int d = 0; d < Nodes::DIM; d++)
+                            gradTriplets[d].push_back(Eigen::Triplet<double>(i - NOD, nsrc + j, grad(d)));
                         }
+                    }
+                }
+            nsrc += NPI;
+            }
+        }
 
-                    std::fill_n(leaf->getTargets()->getPotentials(),
-                                leaf->getTargets()->getNbParticles(), 0);
-                });
+    /** sums the charges of each element into aggDen */
+    void aggregateCharges(void)
+        {
+        int nsrc(0);
+        for (unsigned int e = 0; e < aggDen.size(); e++)
+            {
+            const int npi = (static_cast<int>(e) < nbTets) ? Tetra::NPI : Facette::NPI;
+            aggDen[e] = std::accumulate(srcDen.begin() + nsrc, srcDen.begin() + nsrc + npi, 0.0);
+            nsrc += npi;
+            }
+        }
 
-        tree.forEachCell([](CellClass *cell) { cell->resetToInitialState(); });
+    /**
+    computes the demag field, with (getter  = u,setter = phi) or (getter = v,setter = phi_v)
+    */
+    void demag(std::function<const Eigen::Vector3d(Nodes::Node)> getter,
+               std::function<void(Nodes::Node &, const double)> setter, Mesh::mesh &msh) override
+        {
+        calc_charges(getter, msh);
+        if (compressed)
+            {
+            aggregateCharges();
+            nearPot = nearCorr * Eigen::Map<const Eigen::VectorXd>(srcDen.data(), srcDen.size());
+            }
+        std::vector<double> const &den = compressed ? aggDen : srcDen;
 
-        algo.execute();
+        // physicalValues[idxPart] = Q, reset potentials, forces and expansions
+        std::for_each(EXEC_POL, leaves.begin(), leaves.end(),
+                      [this, &den](leafData const &l)
+                      {
+                          Real *const physicalValues = l.leaf->getSrc()->getPhysicalValues();
+                          const int *const idx = srcIdx.data() + l.srcBegin;
+                          for (int idxPart = 0; idxPart < l.leaf->getSrc()->getNbParticles(); ++idxPart)
+                              physicalValues[idxPart] = static_cast<Real>(den[idx[idxPart]]);
+                          ContainerClass *const targets = l.leaf->getTargets();
+                          const int nbTargets = targets->getNbParticles();
+                          std::fill_n(targets->getPotentials(), nbTargets, 0);
+                          std::fill_n(targets->getForcesX(), nbTargets, 0);
+                          std::fill_n(targets->getForcesY(), nbTargets, 0);
+                          std::fill_n(targets->getForcesZ(), nbTargets, 0);
+                      });
+        std::for_each(EXEC_POL, cells.begin(), cells.end(),
+                      [](CellClass *cell) { cell->resetToInitialState(); });
+
+        algo->execute();
+
+        // the forces on the probes, of unit charge, are the gradients of the potential in the frame
+        // of the octree: the factor norm of the potentials is squared for their gradients
+        std::for_each(EXEC_POL, leaves.begin(), leaves.end(),
+                      [this](leafData const &l)
+                      {
+                          ContainerClass *const targets = l.leaf->getTargets();
+                          const Real *const potentials = targets->getPotentials();
+                          const int *const idx = tgtIdx.data() + l.tgtBegin;
+                          for (int idxPart = 0; idxPart < targets->getNbParticles(); ++idxPart)
+                              {
+                              const int i = idx[idxPart];
+                              pot[i] = static_cast<double>(potentials[idxPart]) * norm;
+                              if (i >= NOD)
+                                  probeGrad[i - NOD] =
+                                          Eigen::Vector3d(targets->getForcesX()[idxPart],
+                                                          targets->getForcesY()[idxPart],
+                                                          targets->getForcesZ()[idxPart])
+                                          * (norm * norm);
+                              }
+                      });
+        if (periodicDirs)
+            {
+            // a node and its periodic images are the same point: the corrections of the elements
+            // around all of them apply to the potential of their master
+            masterCorr.assign(NOD, 0);
+            for (int i = 0; i < NOD; i++)
+                masterCorr[msh.getMaster(i)] += corr[i];
+            for (int i = 0; i < NOD; i++)
+                {
+                const int m = msh.getMaster(i);
+                msh.set(i, setter, (pot[m] + masterCorr[m]) / (4 * M_PI));
+                }
+            return;
+            }
+        for (int i = 0; i < NOD; i++)
+            {
+            double val = pot[i] + corr[i];
+            if (compressed) val += nearPot(i);
+            msh.set(i, setter, val / (4 * M_PI));
+            }
+        }
 
-        tree.forEachLeaf(
-                [this, &msh, setter](LeafClass *leaf)
+    /** potential and field on the probes, from the potentials and forces of the probe targets */
+    void updateProbes(void) override
+        {
+        if (probePhi.empty()) return;
+        Eigen::Map<const Eigen::VectorXd> den(srcDen.data(), srcDen.size());
+        Eigen::VectorXd nearGradVal[Nodes::DIM];
+        if (compressed)
+            for (int d = 0; d < Nodes::DIM; d++)
+                nearGradVal[d] = nearGrad[d] * den;
+        for (unsigned int k = 0; k < probePhi.size(); k++)
+            {
+            const int i = NOD + k;
+            double phi = pot[i];
+            Eigen::Vector3d grad = probeGrad[k];
+            if (compressed)
                 {
-                    const FReal *const potentials = leaf->getTargets()->getPotentials();
-                    const int nbParticlesInLeaf = leaf->getTargets()->getNbParticles();
-                    const auto &indexes = leaf->getTargets()->getIndexes();
-                    for (int idxPart = 0; idxPart < nbParticlesInLeaf; ++idxPart)
-                        {
-                        const int indexPartOrig = indexes[idxPart];
-                        msh.set(indexPartOrig, setter,
-                                (potentials[idxPart] * norm + corr[indexPartOrig]) / (4 * M_PI));
-                        }
-                });
+                phi += nearPot(i);
+                for (int d = 0; d < Nodes::DIM; d++)
+                    grad(d) += nearGradVal[d](k);
+                }
+            probePhi[k] = phi / (4 * M_PI);
+            probeH[k] = -grad / (4 * M_PI);
+            }
         }
     };  // end class fmm
 
+/** \return a new fmm demag solver, using the scalfmm kernel k */
+inline std::unique_ptr<demagSolver> make_fmm(const fmm_kernel k /**< [in] */,
+                                             Mesh::mesh &msh /**< [in] */,
+                                             std::vector<Tetra::prm> &prmTet /**< [in] */,
+                                             std::vector<Facette::prm> &prmFac /**< [in] */,
+                                             const int ScalfmmNbThreads /**< [in] */,
+                                             const double nearFieldRadius = 0 /**< [in] */,
+                                             std::vector<Eigen::Vector3d> const &probes = {} /**< [in] */,
+                                             const int imageShells = 3 /**< [in] */)
+    {
+    switch (k)
+        {
+        case SPHERICAL:
+            return std::make_unique<fmm<sphericalKernel<>>>(msh, prmTet, prmFac, ScalfmmNbThreads,
+                                                          nearFieldRadius, probes, imageShells);
+        case CHEBYSHEV:
+            return std::make_unique<fmm<chebyshevKernel<>>>(msh, prmTet, prmFac, ScalfmmNbThreads,
+                                                          nearFieldRadius, probes, imageShells);
+        case UNIFORM:
+            return std::make_unique<fmm<uniformKernel<>>>(msh, prmTet, prmFac, ScalfmmNbThreads,
+                                                        nearFieldRadius, probes, imageShells);
+        default:
+            return std::make_unique<fmm<rotationKernel<>>>(msh, prmTet, prmFac, ScalfmmNbThreads,
+                                                         nearFieldRadius, probes, imageShells);
+        }
+    }
+
     }  // namespace scal_fmm
 #endif
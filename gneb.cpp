@@ -0,0 +1,315 @@
+/**
+  Geodesic nudged elastic band: minimum energy path between two states of the magnetization, with
+  climbing image and velocity projection optimizer. The effective fields of the images are computed
+  concurrently by gneb.concurrent_images evaluators: the first one uses the mesh and the demag
+  solver of the simulation, the others their own copies.
+ */
+
+#include <numeric>
+#include <signal.h>
+
+#include "demagSolver.h"
+#include "fem.h"
+#include "time_integration.h"
+
+/** magnetization of all the nodes */
+typedef std::vector<Eigen::Vector3d> Config;
+
+/** \return the angle between the unit vectors a and b */
+static double angle(Eigen::Vector3d const &a, Eigen::Vector3d const &b)
+    {
+    return atan2(a.cross(b).norm(), a.dot(b));
+    }
+
+/** \return the geodesic distance between two configurations */
+static double distance(Config const &a, Config const &b)
+    {
+    double d2(0);
+    for (unsigned int i = 0; i < a.size(); i++)
+        d2 += Nodes::sq(angle(a[i], b[i]));
+    return sqrt(d2);
+    }
+
+/** \return the point at fraction s of the great circle from a to b. For opposite vectors, the
+ * rotation axis is chosen perpendicular to a */
+static Eigen::Vector3d slerp(Eigen::Vector3d const &a, Eigen::Vector3d const &b, const double s)
+    {
+    const double theta = angle(a, b);
+    if (theta < 1e-8) return a;
+    Eigen::Vector3d axis = a.cross(b);
+    if (axis.norm() < 1e-8)
+        axis = a.unitOrthogonal();
+    return Eigen::AngleAxisd(s * theta, axis.normalized()) * a;
+    }
+
+/** what the energy and the effective field of an image are computed with */
+struct Evaluator
+    {
+    Settings *settings;     /**< settings, the expression parsers are not thread safe */
+    Fem *fem;               /**< mesh holding the image */
+    demagSolver *demagSol;  /**< demag solver */
+    std::unique_ptr<Settings> ownSettings;     /**< settings read again, if not the shared ones */
+    std::unique_ptr<Fem> ownFem;               /**< copy of the mesh, if not the shared one */
+    std::unique_ptr<demagSolver> ownDemagSol;  /**< demag solver, if not the shared one */
+    std::vector<Eigen::Vector3d> H;            /**< effective field */
+    };
+
+/** builds an evaluator with its own settings, mesh and demag solver. The threads of scalfmm are
+ * shared among the nbEvaluators evaluators */
+static void buildEvaluator(Evaluator &ev, Settings const &settings, const int nbEvaluators)
+    {
+    ev.ownSettings = std::make_unique<Settings>();
+    ev.ownSettings->verbose = false;
+    ev.ownSettings->setFileDisplayName(settings.getFileDisplayName());
+    for (YAML::Node const &doc : settings.getDocuments())
+        ev.ownSettings->read(doc);
+    ev.ownSettings->scalfmmNbTh = std::max(1, settings.scalfmmNbTh / nbEvaluators);
+    timing t_prm(settings.tf, settings.dt_min, settings.dt_max);
+    ev.ownFem = std::make_unique<Fem>(*ev.ownSettings, t_prm);
+    ev.ownDemagSol = makeDemagSolver(*ev.ownSettings, ev.ownFem->msh);
+    ev.settings = ev.ownSettings.get();
+    ev.fem = ev.ownFem.get();
+    ev.demagSol = ev.ownDemagSol.get();
+    }
+
+/** save the images of the path, with their demag potentials, as <baseName>_image<k>.sol */
+static void save_images(Fem &fem, Settings const &settings, demagSolver &demagSol,
+                        std::vector<Config> const &image, std::string const &baseName,
+                        const double t)
+    {
+    std::string metadata = settings.solMetadata(t, "idx\tmx\tmy\tmz\tphi");
+    for (unsigned int k = 0; k < image.size(); k++)
+        {
+        for (int i = 0; i < fem.msh.getNbNodes(); i++)
+            fem.msh.setNode_u(i, image[k][i]);
+        demagSol.calc_phi(fem.msh);
+        fem.msh.savesol(settings.getPrecision(), baseName + "_image" + std::to_string(k) + ".sol",
+                        metadata);
+        }
+    }
+
+int gneb(Fem &fem, Settings &settings, demagSolver &demagSol, timing const &t_prm, int &nt)
+    {
+    const double max_angle = 0.2;  // largest rotation of a node in one iteration
+    const double t = t_prm.get_t();
+    const int NOD = fem.msh.getNbNodes();
+    const int M = settings.gnebImages;
+
+    // initial path: geodesic interpolation between the initial and the final states
+    std::vector<Config> image(M, Config(NOD));
+    for (int i = 0; i < NOD; i++)
+        image[0][i] = fem.msh.getNode_u(i);
+    fem.msh.readSol(settings.verbose, settings.gnebFinalFileName);
+    fem.msh.syncPeriodicNodes();
+    for (int i = 0; i < NOD; i++)
+        image[M - 1][i] = fem.msh.getNode_u(i).normalized();
+    for (int k = 1; k < M - 1; k++)
+        for (int i = 0; i < NOD; i++)
+            image[k][i] = slerp(image[0][i], image[M - 1][i], double(k) / (M - 1));
+
+    std::vector<Config> force(M, Config(NOD));
+    std::vector<Config> velocity(M, Config(NOD, Eigen::Vector3d::Zero()));
+    std::vector<double> E(M), dist(M - 1), maxForce(M, 0);
+    const std::vector<bool> frozen = fem.msh.frozenNodes(settings.paramTetra);
+
+    // the evaluators are built one after the other: reading a mesh is not thread safe
+    int nbEvaluators = std::min(settings.gnebConcurrent, M - 2);
+    if (nbEvaluators > 1 && settings.getDocuments().empty())
+        {
+        std::cout << "WARNING: no settings to read again, the images are evaluated one at a time.\n";
+        nbEvaluators = 1;
+        }
+    std::vector<Evaluator> evaluators(nbEvaluators);
+    evaluators[0].settings = &settings;
+    evaluators[0].fem = &fem;
+    evaluators[0].demagSol = &demagSol;
+    for (int w = 1; w < nbEvaluators; w++)
+        buildEvaluator(evaluators[w], settings, nbEvaluators);
+
+    // energy of image k, and if withForce the effective field projected on the tangent planes, zero
+    // on the frozen nodes
+    auto evaluate = [&](Evaluator &ev, const int k, const bool withForce)
+        {
+        for (int i = 0; i < NOD; i++)
+            ev.fem->msh.setNode_u(i, image[k][i]);
+        ev.demagSol->calc_phi(ev.fem->msh);
+        ev.fem->energy(t, *ev.settings);
+        E[k] = ev.fem->Etot;
+        if (withForce)
+            {
+            ev.fem->effectiveField(t, *ev.settings, ev.H);
+            for (int i = 0; i < NOD; i++)
+                {
+                Eigen::Vector3d const &u = image[k][i];
+                force[k][i] = frozen[i] ? Eigen::Vector3d::Zero()
+                                        : Eigen::Vector3d(mu0 * (ev.H[i] - ev.H[i].dot(u) * u));
+                }
+            }
+        };
+    evaluate(evaluators[0], 0, false);
+    evaluate(evaluators[0], M - 1, false);
+
+    std::string baseName = settings.r_path_output_dir + '/' + settings.getSimName();
+    std::string str = baseName + "_gneb.evol";
+    std::ofstream fout(str);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    std::string columns = "iter\tmax(force)\tclimbing";
+    for (int k = 0; k < M; k++)
+        columns += "\tE_" + std::to_string(k);
+    fout << settings.columnsMetadata(columns);
+    fout.precision(16);
+
+    std::cout << "GNEB: " << M << " images, max(force) = " << settings.gnebMaxForce << " T, "
+              << nbEvaluators << " concurrent evaluations\n";
+    std::vector<int> interior(M - 2);
+    std::iota(interior.begin(), interior.end(), 1);
+    std::vector<int> workers(nbEvaluators);
+    std::iota(workers.begin(), workers.end(), 0);
+    int status(1);
+    for (nt = 0; nt < settings.gnebMaxIter; nt++)
+        {
+        extern volatile sig_atomic_t received_signal;  // set by signal_handler() in main.cpp
+        if (received_signal)
+            {
+            std::cout << "\nReceived signal: stopping the path optimization.\n";
+            break;
+            }
+
+        std::for_each(EXEC_POL, workers.begin(), workers.end(),
+                      [&](const int w)
+                      {
+                          for (int k = 1 + w; k < M - 1; k += nbEvaluators)
+                              evaluate(evaluators[w], k, true);
+                      });
+        for (int k = 0; k < M - 1; k++)
+            dist[k] = distance(image[k], image[k + 1]);
+        int climbing(-1);
+        if (settings.gnebClimbing && nt >= settings.gnebClimbingAfter)
+            climbing = std::max_element(E.begin() + 1, E.end() - 1) - E.begin();
+
+        // geodesic tangent (upwind, Henkelman and Jónsson), spring force along it and true force
+        // perpendicular to it, or reversed along it for the climbing image
+        std::for_each(EXEC_POL, interior.begin(), interior.end(),
+                      [&](const int k)
+                      {
+                          double wp(1), wm(1);  // weights of the differences with k+1 and k-1
+                          if (E[k + 1] > E[k] && E[k] > E[k - 1])
+                              wm = 0;
+                          else if (E[k + 1] < E[k] && E[k] < E[k - 1])
+                              wp = 0;
+                          else
+                              {
+                              const double dEp = fabs(E[k + 1] - E[k]);
+                              const double dEm = fabs(E[k - 1] - E[k]);
+                              wp = (E[k + 1] > E[k - 1]) ? std::max(dEp, dEm) : std::min(dEp, dEm);
+                              wm = (E[k + 1] > E[k - 1]) ? std::min(dEp, dEm) : std::max(dEp, dEm);
+                              }
+                          Config tau(NOD);
+                          double norm2(0);
+                          for (int i = 0; i < NOD; i++)
+                              {
+                              Eigen::Vector3d const &u = image[k][i];
+                              tau[i] = wp * (image[k + 1][i] - u) + wm * (u - image[k - 1][i]);
+                              tau[i] -= tau[i].dot(u) * u;
+                              if (frozen[i]) tau[i].setZero();
+                              norm2 += tau[i].squaredNorm();
+                              }
+                          // no tangent between identical images, or if it is frozen
+                          const double inv_norm = (norm2 > 0) ? 1 / sqrt(norm2) : 0;
+                          double Ftau(0);
+                          for (int i = 0; i < NOD; i++)
+                              {
+                              tau[i] *= inv_norm;
+                              Ftau += force[k][i].dot(tau[i]);
+                              }
+                          const double c = (k == climbing)
+                                                   ? -2 * Ftau
+                                                   : settings.gnebSpring * (dist[k] - dist[k - 1]) - Ftau;
+                          maxForce[k] = 0;
+                          for (int i = 0; i < NOD; i++)
+                              {
+                              force[k][i] += c * tau[i];
+                              maxForce[k] = std::max(maxForce[k], force[k][i].norm());
+                              }
+                      });
+
+        const double F = *std::max_element(maxForce.begin(), maxForce.end());
+        fout << nt << '\t' << F << '\t' << climbing;
+        for (int k = 0; k < M; k++)
+            fout << '\t' << E[k];
+        fout << std::endl;
+        if (settings.verbose)
+            std::cout << "iter " << nt << ": max(force) = " << F << " T, climbing image "
+                      << climbing << std::endl;
+        if (F < settings.gnebMaxForce)
+            {
+            status = 0;
+            break;
+            }
+        if (settings.save_period && nt > 0 && (nt % settings.save_period) == 0)
+            save_images(fem, settings, demagSol, image, baseName, t);
+
+        // velocity projection: only the velocity along the force is kept, and only if it points
+        // in the direction of the force
+        std::for_each(EXEC_POL, interior.begin(), interior.end(),
+                      [&](const int k)
+                      {
+                          double vF(0), FF(0), v_max(0);
+                          for (int i = 0; i < NOD; i++)
+                              {
+                              vF += velocity[k][i].dot(force[k][i]);
+                              FF += force[k][i].squaredNorm();
+                              }
+                          const double c = (vF > 0 && FF > 0) ? vF / FF : 0;
+                          for (int i = 0; i < NOD; i++)
+                              {
+                              velocity[k][i] = (c + settings.gnebStep) * force[k][i];
+                              v_max = std::max(v_max, velocity[k][i].norm());
+                              }
+                          const double scale = (settings.gnebStep * v_max > max_angle)
+                                                       ? max_angle / (settings.gnebStep * v_max)
+                                                       : 1;
+                          for (int i = 0; i < NOD; i++)
+                              {
+                              Eigen::Vector3d &u = image[k][i];
+                              u = (u + settings.gnebStep * scale * velocity[k][i]).normalized();
+                              velocity[k][i] -= velocity[k][i].dot(u) * u;
+                              }
+                      });
+        }
+    fout.close();
+
+    if (status == 0)
+        std::cout << "converged in " << nt << " iterations\n";
+    else
+        std::cout << "not converged after " << nt << " iterations\n";
+    const int saddle = std::max_element(E.begin(), E.end()) - E.begin();
+    std::cout << "highest image: " << saddle << ", energy barrier from the initial state: "
+              << E[saddle] - E[0] << " J\n";
+
+    // energies along the path, versus the geodesic distance from the initial state
+    str = baseName + "_gneb_path.evol";
+    std::ofstream fpath(str);
+    if (fpath.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    fpath << settings.columnsMetadata("image\tdistance\tE\tE-E_0");
+    fpath.precision(16);
+    double s(0);
+    for (int k = 0; k < M; k++)
+        {
+        if (k > 0) s += distance(image[k - 1], image[k]);
+        fpath << k << '\t' << s << '\t' << E[k] << '\t' << E[k] - E[0] << '\n';
+        }
+    fpath.close();
+
+    save_images(fem, settings, demagSol, image, baseName, t);
+    std::cout << "Images saved to " << baseName << "_image<k>.sol\n";
+    return status;
+    }
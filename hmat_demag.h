@@ -0,0 +1,70 @@
+#ifndef HMAT_DEMAG_H
+#define HMAT_DEMAG_H
+
+/** \file hmat_demag.h
+\brief demag field computed with a hierarchical matrix. The operator mapping the charges on the
+Gauss points to the potentials on the nodes only depends on the mesh: it is compressed once by the
+constructor, each call to calc_demag is then a parallel matrix vector product.
+*/
+
+#include "demagSolver.h"
+#include "hmatrix.h"
+#include "mesh.h"
+
+namespace hmat
+    {
+/** \class solver
+demag solver using the hierarchical matrix approximation of the charge to potential operator
+*/
+class solver : public demagSolver
+    {
+public:
+    /** constructor, compress the operator */
+    inline solver(Mesh::mesh &msh /**< [in] */,
+                  std::vector<Tetra::prm> &prmTet /**< [in] */,
+                  std::vector<Facette::prm> &prmFac /**< [in] */,
+                  const double eps /**< [in] ACA tolerance */,
+                  const double eta /**< [in] admissibility parameter */,
+                  const int leafSize /**< [in] maximum number of points in a leaf */)
+        : demagSolver(msh, prmTet, prmFac),
+          H(nodePositions(msh), sourcePositions(msh), eps, eta, leafSize)
+        {
+        pot.resize(NOD);
+        }
+
+    /** ratio of the number of stored coefficients over the size of the dense operator */
+    inline double compressionRatio(void) const { return H.compressionRatio(); }
+
+    /** memory used by the compressed operator, in bytes */
+    inline double memory(void) const { return sizeof(double) * static_cast<double>(H.nbCoeffs()); }
+
+    /** print some informations on the compressed operator */
+    void infos(void) const override
+        {
+        std::cout << "  H-matrix: " << H.nbLowRankBlocks() << " low rank blocks, "
+                  << H.nbDenseBlocks() << " dense blocks, " << memory() / 1048576.0 << " MiB ("
+                  << 100 * compressionRatio() << "% of dense)\n";
+        }
+
+private:
+    hmatrix H; /**< compressed operator */
+
+    std::vector<double> pot; /**< potentials on the nodes, without corrections */
+
+    /**
+    computes the demag field, with (getter  = u,setter = phi) or (getter = v,setter = phi_v)
+    */
+    void demag(std::function<const Eigen::Vector3d(Nodes::Node)> getter,
+               std::function<void(Nodes::Node &, const double)> setter, Mesh::mesh &msh) override
+        {
+        calc_charges(getter, msh);
+        H.apply(srcDen, pot);
+        for (int i = 0; i < NOD; i++)
+            {
+            msh.set(i, setter, (pot[i] + corr[i]) / (4 * M_PI));
+            }
+        }
+    };  // end class solver
+
+    }  // namespace hmat
+#endif
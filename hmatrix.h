@@ -0,0 +1,389 @@
+#ifndef hmatrix_h
+#define hmatrix_h
+
+/** \file hmatrix.h
+\brief hierarchical matrix approximation of the dense operator G(i,j) = 1/|x_i - y_j| between a
+cloud of targets x and a cloud of sources y. Both clouds are organized in cluster trees, the blocks
+of well separated clusters are compressed once for all with the adaptive cross approximation (ACA)
+with partial pivoting, the other blocks are stored as dense matrices. The matrix vector product is
+computed in parallel.
+*/
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <execution>
+#pragma GCC diagnostic pop
+
+#include <eigen3/Eigen/Dense>
+
+#include "config.h"
+
+/** \namespace hmat
+to grab altogether the cluster trees and the hierarchical matrix used for the demag field
+*/
+namespace hmat
+    {
+/** \struct cluster
+node of a cluster tree: contiguous range [begin, end) of point indices in cluster order, with the
+bounding box of the points
+*/
+struct cluster
+    {
+    int begin;              /**< first point */
+    int end;                /**< one past the last point */
+    Eigen::Vector3d bbMin;  /**< lower corner of the bounding box */
+    Eigen::Vector3d bbMax;  /**< upper corner of the bounding box */
+    int child[2] = {-1, -1}; /**< indices of the sons in the cluster tree, -1 for a leaf */
+
+    /** number of points */
+    inline int size(void) const { return end - begin; }
+
+    /** true if the cluster has no sons */
+    inline bool isLeaf(void) const { return child[0] < 0; }
+
+    /** diameter of the bounding box */
+    inline double diam(void) const { return (bbMax - bbMin).norm(); }
+    };
+
+/** distance between the bounding boxes of two clusters */
+inline double dist(cluster const &a, cluster const &b)
+    {
+    Eigen::Vector3d d = (a.bbMin - b.bbMax).cwiseMax(b.bbMin - a.bbMax).cwiseMax(0.0);
+    return d.norm();
+    }
+
+/** \class clusterTree
+binary tree of clusters, built by recursive bisection of the bounding boxes along their longest
+axis, until clusters have no more than leafSize points
+*/
+class clusterTree
+    {
+public:
+    /** constructor, pts must not be empty */
+    clusterTree(std::vector<Eigen::Vector3d> const &pts /**< [in] */, const int leafSize /**< [in] */)
+        : perm(pts.size())
+        {
+        std::iota(perm.begin(), perm.end(), 0);
+        nodes.reserve(4 * pts.size() / std::max(leafSize, 1) + 1);
+        build(pts, 0, pts.size(), std::max(leafSize, 1));
+        }
+
+    /** perm[k] is the index of the k-th point in cluster order */
+    std::vector<int> perm;
+
+    /** clusters, the root is nodes[0] */
+    std::vector<cluster> nodes;
+
+private:
+    /** build recursively the cluster of points perm[begin..end), returns its index in nodes */
+    int build(std::vector<Eigen::Vector3d> const &pts, const int begin, const int end,
+              const int leafSize)
+        {
+        cluster c;
+        c.begin = begin;
+        c.end = end;
+        c.bbMin = c.bbMax = pts[perm[begin]];
+        for (int k = begin + 1; k < end; k++)
+            {
+            c.bbMin = c.bbMin.cwiseMin(pts[perm[k]]);
+            c.bbMax = c.bbMax.cwiseMax(pts[perm[k]]);
+            }
+        const int idx = nodes.size();
+        nodes.push_back(c);
+
+        if (end - begin > leafSize)
+            {
+            int axis;
+            (c.bbMax - c.bbMin).maxCoeff(&axis);
+            const int mid = begin + (end - begin) / 2;
+            std::nth_element(perm.begin() + begin, perm.begin() + mid, perm.begin() + end,
+                             [&pts, axis](int i, int j) { return pts[i](axis) < pts[j](axis); });
+            const int c0 = build(pts, begin, mid, leafSize);
+            const int c1 = build(pts, mid, end, leafSize);
+            nodes[idx].child[0] = c0;
+            nodes[idx].child[1] = c1;
+            }
+        return idx;
+        }
+    };
+
+/** \struct block
+block of the hierarchical matrix, between target cluster t and source cluster s. A low rank block
+is approximated by U V^T, a dense block is stored in U, V is then empty.
+*/
+struct block
+    {
+    int t;             /**< index of the target cluster */
+    int s;             /**< index of the source cluster */
+    bool lowRank;      /**< true if compressed */
+    Eigen::MatrixXd U; /**< left factor, or dense block */
+    Eigen::MatrixXd V; /**< right factor */
+    };
+
+/** \class hmatrix
+hierarchical matrix approximation of G(i,j) = 1/|x_i - y_j|. A block (t,s) is admissible if
+min(diam(t), diam(s)) < eta dist(t,s), and is then compressed with ACA up to relative tolerance
+eps. Smaller eps or smaller eta give a better accuracy and a larger memory footprint.
+*/
+class hmatrix
+    {
+public:
+    /** constructor, compress the operator. targets and sources must not be empty */
+    hmatrix(std::vector<Eigen::Vector3d> const &targets /**< [in] */,
+            std::vector<Eigen::Vector3d> const &sources /**< [in] */,
+            const double _eps /**< [in] ACA tolerance */,
+            const double _eta /**< [in] admissibility parameter */,
+            const int leafSize /**< [in] maximum number of points in a leaf */)
+        : eps(_eps), eta(_eta), rowTree(targets, leafSize), colTree(sources, leafSize),
+          X(3, targets.size()), Y(3, sources.size())
+        {
+        for (unsigned int k = 0; k < targets.size(); k++)
+            X.col(k) = targets[rowTree.perm[k]];
+        for (unsigned int k = 0; k < sources.size(); k++)
+            Y.col(k) = sources[colTree.perm[k]];
+
+        buildBlocks(0, 0);
+        std::for_each(EXEC_POL, blocks.begin(), blocks.end(),
+                      [this](block &b)
+                      {
+                          cluster const &t = rowTree.nodes[b.t];
+                          cluster const &s = colTree.nodes[b.s];
+                          if (!(b.lowRank && aca(t, s, b.U, b.V)))
+                              {
+                              b.lowRank = false;
+                              b.V.resize(0, 0);
+                              b.U.resize(t.size(), s.size());
+                              for (int j = 0; j < s.size(); j++)
+                                  for (int i = 0; i < t.size(); i++)
+                                      b.U(i, j) = entry(t.begin + i, s.begin + j);
+                              }
+                      });
+
+        // list the contributions of all blocks to each target leaf
+        for (unsigned int k = 0; k < rowTree.nodes.size(); k++)
+            {
+            if (rowTree.nodes[k].isLeaf()) leaves.push_back(k);
+            }
+        leafContrib.resize(rowTree.nodes.size());
+        for (unsigned int b = 0; b < blocks.size(); b++)
+            { addContrib(b, blocks[b].t); }
+        z.resize(blocks.size());
+        }
+
+    /** y = G q, with q indexed as sources and y indexed as targets */
+    void apply(std::vector<double> const &q /**< [in] */, std::vector<double> &y /**< [out] */)
+        {
+        const int nbRows = X.cols();
+        const int nbCols = Y.cols();
+        qp.resize(nbCols);
+        yp.resize(nbRows);
+        for (int k = 0; k < nbCols; k++)
+            qp(k) = q[colTree.perm[k]];
+
+        // first stage: products of the sources by the right factors (or by the dense blocks)
+        std::vector<int> idx(blocks.size());
+        std::iota(idx.begin(), idx.end(), 0);
+        std::for_each(EXEC_POL, idx.begin(), idx.end(),
+                      [this](const int k)
+                      {
+                          block const &b = blocks[k];
+                          cluster const &s = colTree.nodes[b.s];
+                          if (b.lowRank)
+                              z[k] = b.V.transpose() * qp.segment(s.begin, s.size());
+                          else
+                              z[k] = b.U * qp.segment(s.begin, s.size());
+                      });
+
+        // second stage: each target leaf gathers the contributions of the blocks it belongs to
+        std::for_each(EXEC_POL, leaves.begin(), leaves.end(),
+                      [this](const int l)
+                      {
+                          cluster const &leaf = rowTree.nodes[l];
+                          Eigen::VectorXd val = Eigen::VectorXd::Zero(leaf.size());
+                          for (auto const &[k, offset] : leafContrib[l])
+                              {
+                              block const &b = blocks[k];
+                              if (b.lowRank)
+                                  val += b.U.middleRows(offset, leaf.size()) * z[k];
+                              else
+                                  val += z[k].segment(offset, leaf.size());
+                              }
+                          yp.segment(leaf.begin, leaf.size()) = val;
+                      });
+
+        y.resize(nbRows);
+        for (int k = 0; k < nbRows; k++)
+            y[rowTree.perm[k]] = yp(k);
+        }
+
+    /** number of stored coefficients */
+    long nbCoeffs(void) const
+        {
+        return std::accumulate(blocks.begin(), blocks.end(), 0L, [](long n, block const &b)
+                               { return n + b.U.size() + b.V.size(); });
+        }
+
+    /** ratio of the number of stored coefficients over the size of the dense matrix */
+    double compressionRatio(void) const
+        { return static_cast<double>(nbCoeffs()) / (static_cast<double>(X.cols()) * Y.cols()); }
+
+    /** number of low rank blocks */
+    int nbLowRankBlocks(void) const
+        {
+        return std::count_if(blocks.begin(), blocks.end(), [](block const &b) { return b.lowRank; });
+        }
+
+    /** number of dense blocks */
+    int nbDenseBlocks(void) const { return blocks.size() - nbLowRankBlocks(); }
+
+private:
+    const double eps; /**< relative tolerance of ACA */
+    const double eta; /**< admissibility parameter */
+
+    clusterTree rowTree; /**< cluster tree of the targets */
+    clusterTree colTree; /**< cluster tree of the sources */
+
+    Eigen::Matrix3Xd X; /**< targets in cluster order */
+    Eigen::Matrix3Xd Y; /**< sources in cluster order */
+
+    std::vector<block> blocks; /**< leaves of the block tree */
+
+    std::vector<int> leaves; /**< indices of the leaves of rowTree */
+
+    /** for each cluster of rowTree, list of (block index, row offset in the block) */
+    std::vector<std::vector<std::pair<int, int>>> leafContrib;
+
+    std::vector<Eigen::VectorXd> z; /**< first stage products, one per block */
+    Eigen::VectorXd qp;             /**< sources in cluster order */
+    Eigen::VectorXd yp;             /**< result in cluster order */
+
+    /** coefficient (i,j) of the operator, in cluster order */
+    inline double entry(const int i, const int j) const
+        {
+        const double r = (X.col(i) - Y.col(j)).norm();
+        return (r > 0) ? 1.0 / r : 0.0;
+        }
+
+    /** recursive construction of the block tree, only its leaves are stored; admissible blocks are
+     * flagged low rank and compressed later */
+    void buildBlocks(const int it, const int is)
+        {
+        cluster const &t = rowTree.nodes[it];
+        cluster const &s = colTree.nodes[is];
+        if (std::min(t.diam(), s.diam()) < eta * dist(t, s))
+            blocks.push_back(block{it, is, true, Eigen::MatrixXd(), Eigen::MatrixXd()});
+        else if (t.isLeaf() && s.isLeaf())
+            blocks.push_back(block{it, is, false, Eigen::MatrixXd(), Eigen::MatrixXd()});
+        else if (t.isLeaf())
+            {
+            buildBlocks(it, s.child[0]);
+            buildBlocks(it, s.child[1]);
+            }
+        else if (s.isLeaf())
+            {
+            buildBlocks(t.child[0], is);
+            buildBlocks(t.child[1], is);
+            }
+        else
+            {
+            for (int ct : t.child)
+                for (int cs : s.child)
+                    buildBlocks(ct, cs);
+            }
+        }
+
+    /** register block b in the contribution lists of the leaves of cluster c */
+    void addContrib(const int b, const int c)
+        {
+        cluster const &node = rowTree.nodes[c];
+        if (node.isLeaf())
+            leafContrib[c].push_back(std::make_pair(b, node.begin - rowTree.nodes[blocks[b].t].begin));
+        else
+            {
+            addContrib(b, node.child[0]);
+            addContrib(b, node.child[1]);
+            }
+        }
+
+    /** adaptive cross approximation with partial pivoting of the block (t,s). Returns false if the
+     * rank needed to reach tolerance eps makes the low rank storage larger than the dense one */
+    bool aca(cluster const &t, cluster const &s, Eigen::MatrixXd &U, Eigen::MatrixXd &V) const
+        {
+        const int m = t.size();
+        const int n = s.size();
+        const int maxRank = (m * n) / (m + n);
+        std::vector<Eigen::VectorXd> us, vs;
+        std::vector<bool> usedRow(m, false);
+        double norm2 = 0;  // estimate of the squared Frobenius norm of the approximation
+        bool converged = false;
+        int i = 0;
+
+        while (!converged && (int)us.size() < maxRank)
+            {
+            usedRow[i] = true;
+            Eigen::VectorXd row(n);
+            for (int j = 0; j < n; j++)
+                row(j) = entry(t.begin + i, s.begin + j);
+            for (unsigned int k = 0; k < us.size(); k++)
+                row -= us[k](i) * vs[k];
+
+            Eigen::Index j;
+            if (row.cwiseAbs().maxCoeff(&j) == 0)
+                {  // row already reproduced, try the next unused one
+                auto it = std::find(usedRow.begin(), usedRow.end(), false);
+                if (it == usedRow.end())
+                    converged = true;
+                else
+                    i = std::distance(usedRow.begin(), it);
+                continue;
+                }
+
+            Eigen::VectorXd v = row / row(j);
+            Eigen::VectorXd u(m);
+            for (int r = 0; r < m; r++)
+                u(r) = entry(t.begin + r, s.begin + j);
+            for (unsigned int k = 0; k < us.size(); k++)
+                u -= vs[k](j) * us[k];
+
+            for (unsigned int k = 0; k < us.size(); k++)
+                norm2 += 2.0 * us[k].dot(u) * vs[k].dot(v);
+            const double uv2 = u.squaredNorm() * v.squaredNorm();
+            norm2 += uv2;
+            us.push_back(u);
+            vs.push_back(v);
+
+            if (uv2 <= eps * eps * norm2)
+                converged = true;
+            else
+                {  // next pivot row: largest entry of u among unused rows
+                double best = -1;
+                for (int r = 0; r < m; r++)
+                    {
+                    if (!usedRow[r] && std::abs(u(r)) > best)
+                        {
+                        best = std::abs(u(r));
+                        i = r;
+                        }
+                    }
+                if (best < 0) converged = true;
+                }
+            }
+
+        if (!converged) return false;
+        U.resize(m, us.size());
+        V.resize(n, vs.size());
+        for (unsigned int k = 0; k < us.size(); k++)
+            {
+            U.col(k) = us[k];
+            V.col(k) = vs[k];
+            }
+        return true;
+        }
+    };  // end class hmatrix
+
+    }  // namespace hmat
+
+#endif
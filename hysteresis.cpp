@@ -0,0 +1,82 @@
+/**
+  Quasi-static hysteresis loop: the magnetization is relaxed on each value of a uniform applied
+  field, starting from the state relaxed on the previous value. The mesh, the demag solver and the
+  linear solver are shared by all the field values.
+ */
+
+#include <signal.h>
+
+#include "demagSolver.h"
+#include "fem.h"
+#include "linear_algebra.h"
+#include "time_integration.h"
+
+int minimize(Fem &fem, Settings &settings, demagSolver &demagSol, timing const &t_prm, int &nt);
+
+int time_integration(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+                     timing &t_prm, int &nt);
+
+int hysteresis(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+               timing &t_prm, int &nt)
+    {
+    const std::string simName = settings.getSimName();
+    const std::string baseName = settings.r_path_output_dir + '/' + simName;
+    const double t_initial = t_prm.get_t();
+    const double dt_initial = t_prm.get_dt();
+
+    std::string str = baseName + "_hysteresis.evol";
+    std::ofstream fout(str);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    fout << settings.columnsMetadata("point\tB\tBx\tBy\tBz\t<Mx>\t<My>\t<Mz>\tE_tot\titer\tstatus");
+    fout.precision(16);
+
+    std::cout << "Hysteresis loop: " << settings.hystFields.size() << " field values along "
+              << settings.hystDirection.transpose() << ", relaxation by "
+              << (settings.hystRelaxation == DYNAMICS ? "dynamics" : "minimization") << "\n";
+    int status(0);
+    nt = 0;
+    for (unsigned int k = 0; k < settings.hystFields.size(); k++)
+        {
+        extern volatile sig_atomic_t received_signal;  // set by signal_handler() in main.cpp
+        if (received_signal)
+            {
+            std::cout << "\nReceived signal: stopping the hysteresis loop.\n";
+            status = 1;
+            break;
+            }
+
+        const double B = settings.hystFields[k];
+        const Eigen::Vector3d Bext = B * settings.hystDirection;
+        settings.setConstantField(Bext);
+        settings.setSimName(simName + "_B" + std::to_string(k));
+        std::cout << "\nfield point " << k << ": B = " << B << " T\n";
+
+        // the relaxation starts from the state of the previous field value, left in the mesh
+        int iter(0), point_status;
+        if (settings.hystRelaxation == DYNAMICS)
+            {
+            t_prm.set_t(t_initial);
+            t_prm.set_dt(dt_initial);
+            point_status = time_integration(fem, settings, linAlg, demagSol, t_prm, iter);
+            }
+        else
+            point_status = minimize(fem, settings, demagSol, t_prm, iter);
+        nt += iter;
+        if (point_status != 0) status = 1;
+
+        fem.energy(t_prm.get_t(), settings);
+        fout << k << '\t' << B << '\t' << Bext.x() << '\t' << Bext.y() << '\t' << Bext.z() << '\t'
+             << fem.msh.avg(Nodes::get_u_comp, Nodes::IDX_X) << '\t'
+             << fem.msh.avg(Nodes::get_u_comp, Nodes::IDX_Y) << '\t'
+             << fem.msh.avg(Nodes::get_u_comp, Nodes::IDX_Z) << '\t' << fem.Etot << '\t' << iter
+             << '\t' << point_status << std::endl;
+        }
+    settings.setSimName(simName);
+    fout.close();
+    std::cout << "\nHysteresis loop saved to " << str << "\n";
+    return status;
+    }
@@ -2,20 +2,44 @@
 
 void LinAlgebra::base_projection()
     {
-    std::mt19937 gen(rand());  // random number generator: standard Mersenne twister initialized
-                               // with pseudo-random seed
     std::uniform_real_distribution<> distrib(0.0, 1.0);
-    double r = distrib(gen);
+    double r = distrib(basisGen);
 
     refMsh->setBasis(M_2_PI * r);
     }
 
+void LinAlgebra::buildDofs(std::vector<bool> const &idle)
+    {
+    std::vector<bool> active(refMsh->getNbDofs(), false);
+    for (Tetra::Tet const &tet : refMsh->tet)
+        if (!prmTetra[tet.idxPrm].frozen)
+            for (int i = 0; i < Tetra::N; i++)
+                if (idle.empty() || !idle[tet.ind[i]]) active[refMsh->getDof(tet.ind[i])] = true;
+
+    std::vector<int> renum(active.size(), -1);
+    NOD = 0;
+    for (unsigned int k = 0; k < active.size(); k++)
+        if (active[k]) renum[k] = NOD++;
+    dof.resize(refMsh->getNbNodes());
+    for (int i = 0; i < refMsh->getNbNodes(); i++)
+        dof[i] = renum[refMsh->getDof(i)];
+
+    activeTet.assign(refMsh->tet.size(), false);
+    for (Tetra::Tet const &tet : refMsh->tet)
+        for (int i = 0; i < Tetra::N; i++)
+            if (dof[tet.ind[i]] >= 0) activeTet[tet.idx] = true;
+    if (verbose && idle.empty() && NOD < refMsh->getNbDofs())
+        std::cout << "frozen nodes: " << refMsh->getNbDofs() - NOD << " degrees of freedom removed\n";
+    }
+
 void LinAlgebra::buildInitGuess(Eigen::Ref<Eigen::VectorXd> G) const
     {
-    for (int i = 0; i < NOD; i++)
+    for (int i = 0; i < refMsh->getNbNodes(); i++)
         {
-        G(i) = refMsh->getProj_ep(i)/gamma0;
-        G(NOD + i) = refMsh->getProj_eq(i)/gamma0;
+        const int k = dof[i];
+        if (k < 0) continue;
+        G(k) = refMsh->getProj_ep(i)/gamma0;
+        G(NOD + k) = refMsh->getProj_eq(i)/gamma0;
         }
     }
 
@@ -28,7 +52,11 @@ void LinAlgebra::prepareElements(Eigen::Vector3d const &Hext /**< [in] applied f
 
     std::for_each(EXEC_POL, refMsh->tet.begin(), refMsh->tet.end(),
                   [this, &calc_Hext, &t_prm](Tetra::Tet &tet)
-                  { tet.integrales(prmTetra[tet.idxPrm], t_prm, calc_Hext, idx_dir, DW_vz); });
+                  {
+                  if (!activeTet[tet.idx]) return;
+                  tet.integrales(prmTetra[tet.idxPrm], t_prm, calc_Hext, idx_dir, DW_vz, temperature,
+                                 thermalNoise(tet));
+                  });
 
     std::for_each(EXEC_POL, refMsh->fac.begin(), refMsh->fac.end(),
                   [this](Facette::Fac &fac)
@@ -44,12 +72,14 @@ void LinAlgebra::prepareElements(double const A_Hext /**< [in] amplitude applied
     std::for_each(EXEC_POL, refMsh->tet.begin(), refMsh->tet.end(),
                   [this, &A_Hext, &t_prm](Tetra::Tet &tet)
                   {
+                  if (!activeTet[tet.idx]) return;
                   Eigen::Matrix<double,Nodes::DIM,Tetra::NPI> sp_H = extSpaceField[tet.idx];
                   std::function<void( Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,Tetra::NPI>> H )> calc_Hext =
                   [&sp_H,&A_Hext](Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,Tetra::NPI>> H)
                         { H = A_Hext*sp_H; };
 
-                  tet.integrales(prmTetra[tet.idxPrm], t_prm, calc_Hext, idx_dir, DW_vz);
+                  tet.integrales(prmTetra[tet.idxPrm], t_prm, calc_Hext, idx_dir, DW_vz, temperature,
+                                 thermalNoise(tet));
                   });
 
     std::for_each(EXEC_POL, refMsh->fac.begin(), refMsh->fac.end(),
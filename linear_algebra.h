@@ -18,6 +18,7 @@
 #include "feellgoodSettings.h"
 #include "mesh.h"
 #include "node.h"
+#include "philox.h"
 #include "tetra.h"
 
 /** \class LinAlgebra
@@ -30,11 +31,13 @@ class LinAlgebra
 public:
     /** constructor */
     inline LinAlgebra(Settings &s /**< [in] */, Mesh::mesh &my_msh /**< [in] */)
-        : NOD(my_msh.getNbNodes()), MAXITER(s.MAXITER), TOL(s.TOL), ILU_tol(s.ILU_tol),
+        : MAXITER(s.MAXITER), TOL(s.TOL), ILU_tol(s.ILU_tol),
           ILU_fill_factor(s.ILU_fill_factor), verbose(s.verbose),
-          prmTetra(s.paramTetra), prmFacette(s.paramFacette), refMsh(&my_msh)
+          prmTetra(s.paramTetra), prmFacette(s.paramFacette), refMsh(&my_msh),
+          temperature(s.temperature), thermalSeed(s.drawSeed()), basisGen(s.drawSeed())
         {
         Eigen::setNbThreads(s.solverNbTh);
+        buildDofs(std::vector<bool>());
         base_projection();
         if (!s.recenter)
             { idx_dir = Nodes::IDX_UNDEF; }
@@ -58,6 +61,16 @@ public:
     */
     int solver(timing const &t_prm /**< [in] */);
 
+    /** move on to the random numbers of the next time step of the thermal field */
+    inline void next_thermal_step(void) { thermalStep++; }
+
+    /** getter for the counter of the time steps of the thermal field */
+    inline uint64_t get_thermal_step(void) const { return thermalStep; }
+
+    /** setter for the counter of the time steps of the thermal field, to replay the random numbers
+     * of rejected time steps */
+    inline void set_thermal_step(const uint64_t k /**< [in] */) { thermalStep = k; }
+
     /** setter for DW_dz */
     inline void set_DW_vz(double vz /**< [in] */) { DW_vz = vz; }
 
@@ -69,12 +82,32 @@ public:
 
     /** computes local vector basis {ep,eq} in the tangeant plane for projection on the elements */
     void base_projection();
+
+    /** leave the idle nodes out of the linear system on the next time steps, on top of the nodes
+     * of the frozen regions, an empty vector solves all of them again */
+    inline void setIdleNodes(std::vector<bool> const &idle /**< [in] indexed by node */)
+        { buildDofs(idle); }
+
+    /** getter for the number of degrees of freedom per component of the linear system */
+    inline int getNbDofs(void) const { return NOD; }
 private:
+    /** numbers the degrees of freedom of the linear system: the degrees of freedom of the mesh
+     * whose nodes all belong to frozen regions, or are all idle, are left out */
+    void buildDofs(std::vector<bool> const &idle /**< [in] indexed by node, may be empty */);
+
     /** recentering index direction if any */
     Nodes::index idx_dir;
 
-    /** number of nodes, also an offset for filling sparseMatrix, initialized by constructor */
-    const int NOD;
+    /** number of degrees of freedom per component (number of nodes without their periodic
+     * images and the frozen nodes), also an offset for filling sparseMatrix, initialized by
+     * constructor */
+    int NOD;
+
+    /** degree of freedom of each node in the linear system, in [0, NOD), -1 for a frozen node */
+    std::vector<int> dof;
+
+    /** true for the tetrahedrons having at least one node that is not frozen, indexed by Tet::idx */
+    std::vector<bool> activeTet;
 
     /** maximum number of iteration for bicgstab */
     const int MAXITER;
@@ -106,6 +139,27 @@ private:
     /** maximum speed of the magnetization in the whole physical object */
     double v_max;
 
+    /** temperature of the thermal fluctuation field */
+    const double temperature;
+
+    /** key of the random numbers of the thermal field */
+    const uint64_t thermalSeed;
+
+    /** counter of the time steps of the thermal field */
+    uint64_t thermalStep = 0;
+
+    /** random number generator of the angle of the tangent bases, seeded once by the constructor,
+     * so that concurrent integrations do not draw from a shared generator */
+    std::mt19937 basisGen;
+
+    /** \return the standard normal vector of the thermal field of a tetrahedron on the current time
+     * step, zero at zero temperature */
+    inline Eigen::Vector3d thermalNoise(Tetra::Tet const &tet) const
+        {
+        if (temperature == 0) return Eigen::Vector3d::Zero();
+        return Philox::normal3(thermalSeed, thermalStep, tet.idx);
+        }
+
     /** external applied space field, values on gauss points, size is number of tetraedrons */
     std::vector< Eigen::Matrix<double,Nodes::DIM,Tetra::NPI> > extSpaceField;
     };// end class linAlgebra
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <memory>
 #include <signal.h>
 #include <stdio.h>      // for perror()
 #include <stdlib.h>     // for getenv()
@@ -7,8 +8,8 @@
 #include <unistd.h>     // for getpid(), stat()
 
 #include "chronometer.h"
+#include "demagSolver.h"
 #include "fem.h"
-#include "fmm_demag.h"
 #include "linear_algebra.h"
 #include "mesh.h"
 #include "time_integration.h"
@@ -73,9 +74,57 @@ static void create_dir_if_needed(std::string dirname)
     }
 
 int time_integration(Fem &fem, Settings &settings /**< [in] */, LinAlgebra &linAlg /**< [in] */,
-                     scal_fmm::fmm &myFMM /**< [in] */, timing &t_prm,
+                     demagSolver &demagSol /**< [in] */, timing &t_prm,
                      int &nt /**< [out] number of time steps performed */);
 
+int minimize(Fem &fem, Settings &settings /**< [in] */, demagSolver &demagSol /**< [in] */,
+             timing const &t_prm, int &nt /**< [out] number of iterations performed */);
+
+int gneb(Fem &fem, Settings &settings /**< [in] */, demagSolver &demagSol /**< [in] */,
+         timing const &t_prm, int &nt /**< [out] number of iterations performed */);
+
+int dimer(Fem &fem, Settings &settings /**< [in] */, demagSolver &demagSol /**< [in] */,
+          timing const &t_prm, int &nt /**< [out] number of iterations performed */);
+
+int hysteresis(Fem &fem, Settings &settings /**< [in] */, LinAlgebra &linAlg /**< [in] */,
+               demagSolver &demagSol /**< [in] */, timing &t_prm,
+               int &nt /**< [out] number of iterations or time steps, over all field values */);
+
+int eigenmodes(Fem &fem, Settings &settings /**< [in] */, demagSolver &demagSol /**< [in] */,
+               timing const &t_prm, int &nt /**< [out] number of products by the Hessian */);
+
+int parareal(Fem &fem, Settings &settings /**< [in] */, LinAlgebra &linAlg /**< [in] */,
+             demagSolver &demagSol /**< [in] */, timing &t_prm,
+             int &nt /**< [out] number of fine time steps, over all iterations */);
+
+void multires(Fem &fem, Settings &settings /**< [in] */);
+
+int batch(Fem &fem, Settings &settings /**< [in] */, demagSolver &demagSol /**< [in] */,
+          int &nt /**< [out] number of iterations or time steps, over all runs */,
+          std::function<int(Fem &, Settings &, demagSolver &, timing &, int &)> const
+                  &simulate /**< [in] one run, on the mesh and demag solver of its group */);
+
+// Run the simulation in the mode given by the settings.
+static int simulate(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+                    timing &t_prm, int &nt)
+    {
+    if (!settings.multiresMeshes.empty()) multires(fem, settings);
+    if (settings.simMode == MINIMIZE)
+        return minimize(fem, settings, demagSol, t_prm, nt);
+    else if (settings.simMode == GNEB)
+        return gneb(fem, settings, demagSol, t_prm, nt);
+    else if (settings.simMode == DIMER)
+        return dimer(fem, settings, demagSol, t_prm, nt);
+    else if (settings.simMode == HYSTERESIS)
+        return hysteresis(fem, settings, linAlg, demagSol, t_prm, nt);
+    else if (settings.simMode == EIGENMODES)
+        return eigenmodes(fem, settings, demagSol, t_prm, nt);
+    else if (settings.simMode == PARAREAL)
+        return parareal(fem, settings, linAlg, demagSol, t_prm, nt);
+    else
+        return time_integration(fem, settings, linAlg, demagSol, t_prm, nt);
+    }
+
 // Return the number of characters in an UTF-8-encoded string.
 static int char_length(const std::string &s)
     {
@@ -105,7 +154,8 @@ void prompt(void)
     std::cout << "\t└────────────────────────────────┘\n";
     }
 
-std::string parseOptions(Settings &settings, int argc, char *argv[], unsigned int &random_seed)
+std::string parseOptions(Settings &settings, int argc, char *argv[], unsigned int &random_seed,
+                         int &demag_bench)
     {
     int print_help = false;
     int print_version = false;
@@ -125,6 +175,7 @@ std::string parseOptions(Settings &settings, int argc, char *argv[], unsigned in
             {"", "--verify", "verify a settings file and exit", &verify},
             {"-v", "--verbose", "enable verbose mode", &settings.verbose},
             {"", "--seed", "set random seed", &use_fixed_seed},
+            {"", "--demag-benchmark", "benchmark demag solvers and exit", &demag_bench},
             {"", "", nullptr, nullptr}  // sentinel
     };
 
@@ -201,13 +252,15 @@ int main(int argc, char *argv[])
     chronometer counter;
 
     unsigned int random_seed;
-    std::string filename = parseOptions(mySettings, argc, argv, random_seed);
+    int demag_bench = false;
+    std::string filename = parseOptions(mySettings, argc, argv, random_seed, demag_bench);
     srand(random_seed);
     prompt();
     if (mySettings.verbose) std::cout << "verbose mode:      on\n";
     std::cout << "feeLLGood version: " << feellgood_version << '\n';
     if (ENABLE_SEQ) std::cout << "sequential mode:   on\n";
     else std::cout << "parallel mode:     on\n";
+    if (ENABLE_FMM_FLOAT) std::cout << "fmm precision:     single\n";
     std::cout << "process ID:        " << std::to_string(getpid()) << '\n';
     std::cout << "random seed:       " << random_seed << '\n';
     mySettings.setFileDisplayName(filename == "-" ? "standard input" : filename);
@@ -247,13 +300,23 @@ int main(int argc, char *argv[])
                                                          mySettings.verbose, 5000, fileName);
         }
 
+    if (demag_bench)
+        return demag_benchmark(mySettings, fem.msh);
+
     chronometer fmm_counter(2);
-    scal_fmm::fmm myFMM(fem.msh, mySettings.paramTetra, mySettings.paramFacette, mySettings.scalfmmNbTh);
+    std::unique_ptr<demagSolver> demagSol = makeDemagSolver(mySettings, fem.msh);
     if (mySettings.verbose)
-            {
+        {
+        if (mySettings.demagMethod == HMATRIX)
+            std::cout << "Magnetostatics: hierarchical matrix compressed in ";
+        else if (mySettings.demagMethod == FFT)
+            std::cout << "Magnetostatics: fft grid initialized in ";
+        else
             std::cout << "Magnetostatics: particles inserted, using " << mySettings.scalfmmNbTh
-                      << " threads, in " << fmm_counter.millis() << std::endl;
-            }
+                      << " threads, in ";
+        std::cout << fmm_counter.millis() << std::endl;
+        demagSol->infos();
+        }
 
     // Catch SIGINT and SIGTERM.
     struct sigaction action;
@@ -271,13 +334,34 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
         }
 
-    int nt;  // number of time steps
-    int status = time_integration(fem, mySettings, linAlg, myFMM, t_prm, nt);
+    int nt;  // number of time steps, or of iterations of the minimization or of the saddle point search
+    int status;
+    if (!mySettings.batchRuns.empty())
+        status = batch(fem, mySettings, *demagSol, nt,
+                       [](Fem &femRun, Settings &settings, demagSolver &demagSolRun, timing &t_run,
+                          int &nt_run)
+                       {
+                           LinAlgebra linAlgRun(settings, femRun.msh);
+                           return simulate(femRun, settings, linAlgRun, demagSolRun, t_run, nt_run);
+                       });
+    else
+        status = simulate(fem, mySettings, linAlg, *demagSol, t_prm, nt);
 
     double total_time = counter.fp_elapsed();
     std::cout << "\nComputing time:\n\n";
     std::cout << "    total: " << counter.convertSeconds(total_time);
-    std::cout << "    per time step: " << total_time / nt << " s\n";
-    if (status != 0) std::cout << "\nIntegration FAILED.\n";
+    if (mySettings.simMode != DYNAMICS)
+        std::cout << "    per iteration: " << total_time / std::max(nt, 1) << " s\n";
+    else
+        std::cout << "    per time step: " << total_time / nt << " s\n";
+    if (status != 0)
+        std::cout << (!mySettings.batchRuns.empty()      ? "\nBatch FAILED.\n"
+                      : mySettings.simMode == DYNAMICS   ? "\nIntegration FAILED.\n"
+                      : mySettings.simMode == MINIMIZE   ? "\nMinimization FAILED.\n"
+                      : mySettings.simMode == HYSTERESIS ? "\nHysteresis loop FAILED.\n"
+                      : mySettings.simMode == EIGENMODES ? "\nEigenmode computation FAILED.\n"
+                      : mySettings.simMode == PARAREAL   ? "\nParareal integration FAILED.\n"
+                      : mySettings.simMode == GNEB       ? "\nMinimum energy path search FAILED.\n"
+                                                         : "\nSaddle point search FAILED.\n");
     return status;
     }
@@ -1,4 +1,6 @@
+#include "ANN.h"
 #include "mesh.h"
+#include "tetLocator.h"
 
 using namespace Mesh;
 
@@ -6,17 +8,56 @@ void mesh::infos(void) const
     {
     std::cout << "mesh:\n";
     std::cout << "  nodes:              " << getNbNodes() << '\n';
+    if (nbDofs < getNbNodes())
+        std::cout << "  periodic images:    " << getNbNodes() - nbDofs << '\n';
     std::cout << "  faces:              " << fac.size() << '\n';
     std::cout << "  tetraedrons:        " << tet.size() << '\n';
     std::cout << "  total volume:       " << vol << '\n';
     }
 
-void mesh::updateNodes(Eigen::Ref<Eigen::VectorXd> X, const double dt)
+void mesh::updateNodes(std::vector<int> const &dof, Eigen::Ref<Eigen::VectorXd> X,
+                       const double dt)
     {
-    const unsigned int NOD = node.size();
+    const int NOD = X.size() / 2;
+    for (unsigned int i = 0; i < node.size(); i++)
+        {
+        if (dof[i] < 0)
+            { node[i].make_evol(0, 0, dt); }
+        else
+            { node[i].make_evol(X(dof[i])*gamma0, X(NOD + dof[i])*gamma0, dt); }
+        }
+    }
+
+void mesh::interpolate(mesh const &source)
+    {
+    TetLocator locator(source.tet, source.node);
+    std::for_each(EXEC_POL, node.begin(), node.end(),
+                  [&source, &locator](Nodes::Node &n)
+                  {
+                  Eigen::Vector4d lambda;
+                  Tetra::Tet const &te = source.tet[locator.locate(n.p, lambda)];
+                  Eigen::Vector3d u = Eigen::Vector3d::Zero();
+                  for (int i = 0; i < Tetra::N; i++)
+                      u += lambda(i) * source.node[te.ind[i]].d[Nodes::NEXT].u;
+                  n.d[Nodes::CURRENT].u = u.normalized();
+                  n.d[Nodes::NEXT].u = n.d[Nodes::CURRENT].u;
+                  n.d[Nodes::NEXT].phi = 0.;
+                  n.d[Nodes::NEXT].phiv = 0.;
+                  });
+    syncPeriodicNodes();
+    }
 
-    for (unsigned int i = 0; i < NOD; i++)
-        { node[i].make_evol(X(i)*gamma0, X(NOD + i)*gamma0, dt); }
+std::vector<bool> mesh::frozenNodes(std::vector<Tetra::prm> const &prmTet) const
+    {
+    std::vector<bool> active(nbDofs, false);
+    for (Tetra::Tet const &te : tet)
+        if (!prmTet[te.idxPrm].frozen)
+            for (int i = 0; i < Tetra::N; i++)
+                active[dof[te.ind[i]]] = true;
+    std::vector<bool> frozen(node.size());
+    for (unsigned int i = 0; i < node.size(); i++)
+        frozen[i] = !active[dof[i]];
+    return frozen;
     }
 
 double mesh::avg(std::function<double(Nodes::Node, Nodes::index)> getter /**< [in] */,
@@ -128,3 +169,105 @@ void mesh::sortNodes(Nodes::index long_axis)
                       facette.ind[2] = node_index[facette.ind[2]];
                   });
     }
+
+void mesh::buildPeriodicity(Settings const &mySets)
+    {
+    const int NOD = node.size();
+    periodic = mySets.periodic;
+    master.resize(NOD);
+    std::iota(master.begin(), master.end(), 0);
+
+    // union find on the nodes, the root of a set of periodic images holds the degree of freedom
+    std::function<int(int)> root = [this, &root](int i)
+        { return (master[i] == i) ? i : (master[i] = root(master[i])); };
+
+    const Eigen::Vector3d pmin = c - 0.5 * l;
+    const char *axis = "XYZ";
+    auto onFace = [this, &pmin, &mySets](const int i, const int d, const bool upper)
+        {
+        const double face = upper ? pmin(d) + l(d) : pmin(d);
+        return fabs(node[i].p(d) - face) < mySets.periodicTol * l(d);
+        };
+    for (int d = 0; d < Nodes::DIM; d++)
+        {
+        if (!periodic[d]) continue;
+        std::vector<int> lower, upper;
+        for (int i = 0; i < NOD; i++)
+            {
+            if (onFace(i, d, false))
+                lower.push_back(i);
+            else if (onFace(i, d, true))
+                upper.push_back(i);
+            }
+        if (lower.empty() || lower.size() != upper.size())
+            {
+            std::cout << "Fatal Error: mesh is not periodic along " << axis[d]
+                      << ", the opposite faces have " << lower.size() << " and " << upper.size()
+                      << " nodes.\n";
+            exit(1);
+            }
+
+        ANNpointArray pts = annAllocPts(lower.size(), Nodes::DIM);
+        if (!pts)
+            {
+            std::cout << "ANN memory error while allocating points" << std::endl;
+            SYSTEM_ERROR;
+            }
+        for (unsigned int k = 0; k < lower.size(); k++)
+            for (int m = 0; m < Nodes::DIM; m++)
+                pts[k][m] = node[lower[k]].p(m);
+        ANNkd_tree kdtree(pts, lower.size(), Nodes::DIM);
+        for (int i : upper)
+            {
+            Eigen::Vector3d q = node[i].p;
+            q(d) -= l(d);
+            ANNcoord queryPt[Nodes::DIM] = {q.x(), q.y(), q.z()};
+            ANNidx nnIdx;
+            ANNdist sqDist;
+            kdtree.annkSearch(queryPt, 1, &nnIdx, &sqDist);
+            if (sqrt(sqDist) > mySets.periodicTol * l(d))
+                {
+                std::cout << "Fatal Error: mesh is not periodic along " << axis[d] << ", node at "
+                          << node[i].p.transpose() << " has no image on the opposite face.\n";
+                exit(1);
+                }
+            const int ri = root(i), rl = root(lower[nnIdx]);
+            if (ri != rl) master[std::max(ri, rl)] = std::min(ri, rl);
+            }
+        annDeallocPts(pts);
+        }
+
+    dof.resize(NOD);
+    nbDofs = 0;
+    for (int i = 0; i < NOD; i++)
+        {
+        master[i] = root(i);
+        if (master[i] == i) dof[i] = nbDofs++;
+        }
+    for (int i = 0; i < NOD; i++)
+        dof[i] = dof[master[i]];
+
+    if (nbDofs < NOD)
+        {
+        // facettes on the periodic faces are not part of the surface of the infinite sample
+        const int nbFacs = fac.size();
+        std::vector<Facette::Fac> kept;
+        kept.reserve(nbFacs);
+        for (Facette::Fac const &fa : fac)
+            {
+            bool onPeriodicFace(false);
+            for (int d = 0; d < Nodes::DIM; d++)
+                for (bool upper : {false, true})
+                    if (periodic[d] && onFace(fa.ind[0], d, upper) && onFace(fa.ind[1], d, upper)
+                        && onFace(fa.ind[2], d, upper))
+                        onPeriodicFace = true;
+            if (!onPeriodicFace) kept.push_back(fa);
+            }
+        fac.swap(kept);
+        if (mySets.verbose)
+            {
+            std::cout << "  periodic: " << NOD - nbDofs << " node images, "
+                      << nbFacs - getNbFacs() << " facettes removed\n";
+            }
+        }
+    }
@@ -6,6 +6,7 @@
 */
 
 #include <algorithm>
+#include <array>
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 #include <execution>
@@ -28,9 +29,12 @@ class mesh
 public:
     /** constructor : read mesh file, reorder indices and computes some values related to the mesh :
      center and length along coordinates,full volume */
-    inline mesh(Settings const &mySets /**< [in] */)
+    inline mesh(Settings const &mySets /**< [in] */) : mesh(mySets, mySets.getPbName()) {}
+
+    /** constructor from another mesh file than the one of the settings, with the same regions */
+    inline mesh(Settings const &mySets /**< [in] */, std::string const &fileName /**< [in] */)
         {
-        readMesh(mySets);
+        readMesh(mySets, fileName);
         indexReorder(mySets.paramTetra);
 
         if (mySets.verbose)
@@ -68,11 +72,44 @@ public:
 
         vol = std::transform_reduce(EXEC_POL, tet.begin(), tet.end(), 0.0, std::plus{},
                                     [](Tetra::Tet const &te) { return te.calc_vol(); });
+        buildPeriodicity(mySets);
         }
 
     /** return number of nodes  */
     inline int getNbNodes(void) const { return node.size(); }
 
+    /** return number of degrees of freedom per component: number of nodes minus number of
+     * periodic images */
+    inline int getNbDofs(void) const { return nbDofs; }
+
+    /** return the degree of freedom of node i */
+    inline int getDof(const int i) const { return dof[i]; }
+
+    /** return the node holding the degree of freedom of node i (i itself if not a periodic
+     * image) */
+    inline int getMaster(const int i) const { return master[i]; }
+
+    /** return the degrees of freedom of all the nodes */
+    inline const std::vector<int> &getDofs(void) const { return dof; }
+
+    /** return true for the nodes held fixed: all the tetrahedrons around the node and its
+     * periodic images belong to frozen regions */
+    std::vector<bool> frozenNodes(std::vector<Tetra::prm> const &prmTet /**< [in] */) const;
+
+    /** return true if the mesh is periodic along direction d */
+    inline bool isPeriodic(const Nodes::index d) const { return periodic[d]; }
+
+    /** copy the magnetization of each node holding a degree of freedom to its periodic images */
+    inline void syncPeriodicNodes(void)
+        {
+        for (unsigned int i = 0; i < node.size(); i++)
+            if (master[i] != static_cast<int>(i))
+                {
+                node[i].d[Nodes::CURRENT].u = node[master[i]].d[Nodes::CURRENT].u;
+                node[i].d[Nodes::NEXT].u = node[master[i]].d[Nodes::NEXT].u;
+                }
+        }
+
     /** return number of triangular fac */
     inline int getNbFacs(void) const { return fac.size(); }
 
@@ -88,6 +125,22 @@ public:
     /** getter : return node.v */
     inline const Eigen::Vector3d getNode_v(const int i) const { return node[i].get_v(Nodes::NEXT); }
 
+    /** setter : node.u of the NEXT step */
+    inline void setNode_u(const int i, Eigen::Vector3d const &u) { node[i].d[Nodes::NEXT].u = u; }
+
+    /** setter : node.v of the NEXT step */
+    inline void setNode_v(const int i, Eigen::Vector3d const &v) { node[i].d[Nodes::NEXT].v = v; }
+
+    /** getter : return node.v of the last accepted time step */
+    inline const Eigen::Vector3d getNode_v_prev(const int i) const
+        { return node[i].get_v(Nodes::CURRENT); }
+
+    /** getter : return node.ep, first vector of the tangent basis */
+    inline const Eigen::Vector3d getNode_ep(const int i) const { return node[i].ep; }
+
+    /** getter : return node.eq, second vector of the tangent basis */
+    inline const Eigen::Vector3d getNode_eq(const int i) const { return node[i].eq; }
+
     /** return projection of speed at node i along ep */
     inline double getProj_ep(const int i) const {return node[i].proj_ep();}
 
@@ -111,8 +164,9 @@ public:
                       [&r](Nodes::Node &nod) { nod.setBasis(r); });
         }
 
-    /** make_evol on all nodes */
-    void updateNodes(Eigen::Ref<Eigen::VectorXd> X, const double dt);
+    /** make_evol on all nodes, dof gives the rows of the nodes in X, -1 for a node that does not
+     * move */
+    void updateNodes(std::vector<int> const &dof, Eigen::Ref<Eigen::VectorXd> X, const double dt);
 
     /** call evolution for all the nodes */
     inline void evolution(void)
@@ -121,6 +175,23 @@ public:
                       [](Nodes::Node &nod) { nod.evolution(); });
         }
 
+    /** copy the data of all the nodes at step k into state */
+    inline void getState(const Nodes::step k /**< [in] */,
+                         std::vector<Nodes::dataNode> &state /**< [out] */) const
+        {
+        state.resize(node.size());
+        for (unsigned int i = 0; i < node.size(); i++)
+            state[i] = node[i].d[k];
+        }
+
+    /** overwrite the data of all the nodes at step k with state */
+    inline void setState(const Nodes::step k /**< [in] */,
+                         std::vector<Nodes::dataNode> const &state /**< [in] */)
+        {
+        for (unsigned int i = 0; i < node.size(); i++)
+            node[i].d[k] = state[i];
+        }
+
     /** isobarycenter */
     Eigen::Vector3d c;
 
@@ -142,6 +213,10 @@ public:
     double readSol(bool VERBOSE /**< [in] */,
                    const std::string fileName /**< [in] input .sol text file */);
 
+    /** interpolates the magnetization of the NEXT step of the mesh source, of the same geometry,
+     * on the nodes, from the barycentric coordinates of the nodes in the tetrahedrons of source */
+    void interpolate(mesh const &source /**< [in] */);
+
     /** computes an analytical initial magnetization distribution as a starting point for the
      * simulation */
     inline void init_distrib(Settings const &mySets /**< [in] */)
@@ -173,8 +248,21 @@ public:
                  std::string const &metadata /**< [in] */,
                  std::vector<double> const &val /**< [in] */) const;
 
+    /** text file (tsv) writing function for a complex vector field on the nodes, such as a mode of
+     * the magnetization: real parts, then imaginary parts */
+    void savesol(const int precision /**< [in] */,
+                 const std::string fileName /**< [in] */,
+                 std::string const &metadata /**< [in] */,
+                 std::vector<Eigen::Vector3d> const &re /**< [in] */,
+                 std::vector<Eigen::Vector3d> const &im /**< [in] */) const;
+
+    /** getter for node[i]; what_to_get will fix what is the part of the node struct to get */
+    inline double get(const int i /**< [in] */,
+                      std::function<double(Nodes::Node const &)> what_to_get /**< [in] */) const
+        { return what_to_get(node[i]); }
+
     /** setter for node[i]; what_to_set will fix what is the part of the node struct to set (usefull
-     * for fmm_demag.h) */
+     * for the demag solvers) */
     inline void set(const int i /**< [in] */,
                     std::function<void(Nodes::Node &, const double)> what_to_set /**< [in] */,
                     const double val /**< [in] */)
@@ -192,8 +280,21 @@ private:
      * This is the inverse of the permutation we applied when sorting the nodes. */
     std::vector<int> node_index;
 
+    /** periodic directions */
+    std::array<bool, Nodes::DIM> periodic;
+
+    /** node holding the degree of freedom of each node */
+    std::vector<int> master;
+
+    /** degree of freedom of each node, in [0, nbDofs) */
+    std::vector<int> dof;
+
+    /** number of degrees of freedom per component */
+    int nbDofs;
+
     /** test if mesh file contains surfaces and regions mentionned in yaml settings and their dimensions */
-    void checkMeshFile(Settings const &mySets /**< [in] */);
+    void checkMeshFile(Settings const &mySets /**< [in] */,
+                       std::string const &fileName /**< [in] */);
     
     /** read Nodes from mesh file */
     void readNodes(Settings const &mySets /**< [in] */);
@@ -205,7 +306,7 @@ private:
     void readTriangles(Settings const &mySets /**< [in] */);
 
     /** reading mesh format 2.2 text file function */
-    void readMesh(Settings const &mySets /**< [in] */);
+    void readMesh(Settings const &mySets /**< [in] */, std::string const &fileName /**< [in] */);
 
     /** loop on nodes to apply predicate 'whatTodo'  */
     double doOnNodes(const double init_val /**< [in] */,
@@ -249,6 +350,12 @@ private:
     */
     void indexReorder(std::vector<Tetra::prm> const &prmTetra);
 
+    /** Pair the nodes of the opposite faces of the periodic directions: the node on the upper face
+     * becomes an image of the node on the lower face, both share the same degree of freedom. The
+     * facettes on the periodic faces are removed, they are not a surface of the infinite sample.
+     * Without periodicity, each node is its own degree of freedom. */
+    void buildPeriodicity(Settings const &mySets /**< [in] */);
+
     /** Sort the nodes along the longest axis of the sample. This should reduce the bandwidth of
      * the matrix we will have to solve for. */
     void sortNodes(Nodes::index long_axis /**< [in] */);
@@ -0,0 +1,141 @@
+/**
+  Direct minimization of the total energy, to find equilibrium states without integrating the
+  dynamics: projected Barzilai–Borwein descent on the unit sphere
+ */
+
+#include <signal.h>
+
+#include "chronometer.h"
+#include "demagSolver.h"
+#include "fem.h"
+#include "time_integration.h"
+
+/** Projected gradient of the energy on the unit sphere, and maximum torque. */
+struct Descent
+    {
+    std::vector<Eigen::Vector3d> H; /**< effective field */
+    std::vector<Eigen::Vector3d> g; /**< tangent gradient \f$ -(H - (H \cdot u) u) \f$ */
+    double torque = 0;              /**< maximum of \f$ \mu_0 |u \times H| \f$ */
+    double g_max = 0;               /**< maximum of \f$ |g| \f$ */
+
+    /** computes the demag potential, the effective field and the tangent gradient at time t on the
+     * NEXT step of the mesh, the gradient is zero on the frozen nodes */
+    void update(Fem &fem, Settings &settings, demagSolver &demagSol, const double t,
+                std::vector<bool> const &frozen)
+        {
+        demagSol.calc_phi(fem.msh);
+        fem.effectiveField(t, settings, H);
+        const int NOD = fem.msh.getNbNodes();
+        g.resize(NOD);
+        torque = 0;
+        g_max = 0;
+        for (int i = 0; i < NOD; i++)
+            {
+            if (frozen[i])
+                {
+                g[i].setZero();
+                continue;
+                }
+            const Eigen::Vector3d u = fem.msh.getNode_u(i);
+            g[i] = -(H[i] - H[i].dot(u) * u);
+            torque = std::max(torque, mu0 * u.cross(H[i]).norm());
+            g_max = std::max(g_max, g[i].norm());
+            }
+        }
+    };
+
+int minimize(Fem &fem, Settings &settings, demagSolver &demagSol, timing const &t_prm, int &nt)
+    {
+    const double max_angle = 0.5;  // largest rotation of a node in one iteration
+    const double first_angle = 0.01;  // rotation of the first iteration
+    const double t = t_prm.get_t();
+    const int NOD = fem.msh.getNbNodes();
+    const std::vector<bool> frozen = fem.msh.frozenNodes(settings.paramTetra);
+
+    std::string baseName = settings.r_path_output_dir + '/' + settings.getSimName();
+    std::string str = baseName + ".evol";
+    std::ofstream fout(str);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    fout << settings.evolMetadata();
+    fout.precision(16);
+
+    std::cout << "Energy minimization: max(torque) = " << settings.minTorque << " T\n";
+    Descent d, d_prev;
+    d.update(fem, settings, demagSol, t, frozen);
+    fem.vmax = 0;
+    fem.energy(t, settings);
+    fem.saver(settings, t_prm, fout, 0);
+
+    std::vector<Eigen::Vector3d> u_prev(NOD);
+    double tau = first_angle / d.g_max;
+    int status(1);
+    for (nt = 1; nt <= settings.minMaxIter; nt++)
+        {
+        extern volatile sig_atomic_t received_signal;  // set by signal_handler() in main.cpp
+        if (received_signal)
+            {
+            std::cout << "\nReceived signal: stopping the minimization.\n";
+            break;
+            }
+        if (d.torque < settings.minTorque)
+            {
+            status = 0;
+            break;
+            }
+
+        // step of at most max_angle along the tangent gradient, projected back on the sphere
+        tau = std::min(tau, max_angle / d.g_max);
+        double du_max(0);
+        for (int i = 0; i < NOD; i++)
+            {
+            u_prev[i] = fem.msh.getNode_u(i);
+            Eigen::Vector3d u = (u_prev[i] - tau * d.g[i]).normalized();
+            du_max = std::max(du_max, (u - u_prev[i]).norm());
+            fem.msh.setNode_u(i, u);
+            }
+        std::swap(d, d_prev);
+        d.update(fem, settings, demagSol, t, frozen);
+
+        // Barzilai–Borwein step, alternating the long and the short one
+        double ss(0), sy(0), yy(0);
+        for (int i = 0; i < NOD; i++)
+            {
+            Eigen::Vector3d s = fem.msh.getNode_u(i) - u_prev[i];
+            Eigen::Vector3d y = d.g[i] - d_prev.g[i];
+            ss += s.squaredNorm();
+            sy += s.dot(y);
+            yy += y.squaredNorm();
+            }
+        if (sy > 0)
+            tau = (nt % 2) ? ss / sy : sy / yy;
+        else
+            tau = first_angle / d.g_max;
+
+        fem.vmax = du_max / t_prm.get_dt();  // so that max_dm is the variation of this iteration
+        fem.energy(t, settings);
+        fem.saver(settings, t_prm, fout, nt);
+        if (settings.verbose)
+            {
+            std::cout << "iter " << nt << ": E = " << fem.Etot << ", max(torque) = " << d.torque
+                      << " T, max(du) = " << du_max << std::endl;
+            }
+        }
+    fout.close();
+    fem.msh.evolution();
+
+    if (status == 0)
+        std::cout << "converged in " << nt - 1 << " iterations";
+    else
+        std::cout << "not converged after " << nt - 1 << " iterations";
+    std::cout << ": E = " << fem.Etot << ", max(torque) = " << d.torque << " T\n";
+
+    std::string fileName = baseName + "_relaxed.sol";
+    std::string metadata = settings.solMetadata(t, "idx\tmx\tmy\tmz\tphi");
+    fem.msh.savesol(settings.getPrecision(), fileName, metadata);
+    std::cout << "Magnetization configuration saved to " << fileName << "\n";
+    return status;
+    }
@@ -0,0 +1,39 @@
+/**
+  Coarse to fine relaxation: the initial magnetization is relaxed by the energy minimizer on a
+  sequence of meshes of the same geometry, each state being interpolated on the next mesh by
+  mesh::interpolate(), up to the mesh of the settings.
+ */
+
+#include "demagSolver.h"
+#include "fem.h"
+#include "time_integration.h"
+
+int minimize(Fem &fem, Settings &settings, demagSolver &demagSol, timing const &t_prm, int &nt);
+
+void multires(Fem &fem, Settings &settings)
+    {
+    const std::string pbName = settings.getPbName();
+    const std::string simName = settings.getSimName();
+    std::unique_ptr<Fem> coarse;
+    for (unsigned int k = 0; k < settings.multiresMeshes.size(); k++)
+        {
+        settings.setPbName(settings.multiresMeshes[k]);
+        settings.setSimName(simName + "_level" + std::to_string(k));
+        std::cout << "\nmulti-resolution level " << k << ": " << settings.getPbName() << std::endl;
+        timing t_level(settings.tf, settings.dt_min, settings.dt_max);
+        auto level = std::make_unique<Fem>(settings, t_level);
+        if (coarse) level->msh.interpolate(coarse->msh);
+        if (settings.verbose) level->msh.infos();
+
+        std::unique_ptr<demagSolver> demagSol = makeDemagSolver(settings, level->msh);
+        int iter(0);
+        if (minimize(*level, settings, *demagSol, t_level, iter) != 0)
+            std::cout << "WARNING: level " << k << " not relaxed, going on with its last state.\n";
+        demagSol.reset();
+        coarse = std::move(level);
+        }
+    settings.setPbName(pbName);
+    settings.setSimName(simName);
+    fem.msh.interpolate(coarse->msh);
+    std::cout << "\nmulti-resolution: magnetization interpolated on " << pbName << "\n\n";
+    }
@@ -0,0 +1,228 @@
+/**
+  Parareal integration in time: the time span is split into slices, whose boundary states are
+  predicted by a cheap coarse propagator, run sequentially on the main mesh, and corrected on each
+  iteration by the fine propagator, run concurrently on every slice:
+
+  U_{n+1} = G(U_n new) + F(U_n old) - G(U_n old)
+
+  Each slice has its own settings, mesh, linear algebra and demag solver, since none of them can be
+  shared between concurrent integrations.
+ */
+
+#include <numeric>
+
+#include "demagSolver.h"
+#include "fem.h"
+#include "linear_algebra.h"
+#include "time_integration.h"
+
+int propagate(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+              timing &t_prm, const double t_end, const double dumax_limit, const int demagEvery,
+              const double demagMaxDu, int &nt);
+
+/** data of all the nodes at one step */
+using State = std::vector<Nodes::dataNode>;
+
+/** fine propagator of a time slice, from output step `first' to output step `last' */
+struct Slice
+    {
+    int first;                           /**< output step of the start of the slice */
+    int last;                            /**< output step of the end of the slice */
+    std::unique_ptr<Settings> settings;  /**< settings, read again from the documents */
+    std::unique_ptr<Fem> fem;            /**< mesh and initial state */
+    std::unique_ptr<LinAlgebra> linAlg;  /**< linear algebra of the time steps */
+    std::unique_ptr<demagSolver> demagSol; /**< demag solver */
+    std::vector<State> outputs;          /**< states on the output steps first+1 to last */
+    std::vector<double> dt;              /**< time step at the output steps */
+    int nt;                              /**< fine time steps of the last pass */
+    int status;                          /**< status of the last pass, 0 on success */
+    };
+
+/** \return the settings of a slice: the documents of the settings read again, quietly. The threads
+ * are shared among the nbSlices concurrent slices */
+static std::unique_ptr<Settings> sliceSettings(Settings const &settings, const int nbSlices)
+    {
+    auto slice = std::make_unique<Settings>();
+    slice->verbose = false;
+    slice->setFileDisplayName(settings.getFileDisplayName());
+    for (YAML::Node const &doc : settings.getDocuments())
+        slice->read(doc);
+    slice->solverNbTh = std::max(1, settings.solverNbTh / nbSlices);
+    slice->scalfmmNbTh = std::max(1, settings.scalfmmNbTh / nbSlices);
+    return slice;
+    }
+
+/** integrate the slice from state U, at time t0, with the fine propagator */
+static void finePass(Slice &slice, State const &U, const double t0, const double time_step)
+    {
+    Settings &settings = *slice.settings;
+    Fem &fem = *slice.fem;
+    fem.msh.setState(Nodes::NEXT, U);
+    timing t_prm(settings.tf, settings.dt_min, settings.dt_max);
+    t_prm.set_t(t0 + slice.first * time_step);
+    slice.nt = 0;
+    slice.status = 0;
+    for (int k = slice.first + 1; k <= slice.last && slice.status == 0; k++)
+        {
+        slice.status = propagate(fem, settings, *slice.linAlg, *slice.demagSol, t_prm,
+                                 t0 + k * time_step, settings.DUMAX, settings.demagRefreshEvery,
+                                 settings.demagRefreshDu, slice.nt);
+        fem.msh.getState(Nodes::NEXT, slice.outputs[k - slice.first - 1]);
+        slice.dt[k - slice.first - 1] = t_prm.get_dt();
+        }
+    }
+
+/** integrate from state U, from the output step first to the output step last, with the coarse
+ * propagator on the main mesh, the result is returned in G */
+static int coarsePass(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+                      State const &U, const double t0, const double time_step, const int first,
+                      const int last, State &G, int &nt)
+    {
+    fem.msh.setState(Nodes::NEXT, U);
+    timing t_prm(settings.tf, settings.dt_min, settings.pararealCoarseDtMax);
+    t_prm.set_t(t0 + first * time_step);
+    int status = propagate(fem, settings, linAlg, demagSol, t_prm, t0 + last * time_step,
+                           settings.pararealCoarseDumax, settings.pararealCoarseDemagEvery, 0, nt);
+    fem.msh.getState(Nodes::NEXT, G);
+    return status;
+    }
+
+int parareal(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+             timing &t_prm, int &nt)
+    {
+    if (settings.getDocuments().empty())
+        {
+        std::cerr << "Fatal Error: parareal mode needs settings read from a file.\n";
+        exit(1);
+        }
+    const double t0 = t_prm.get_t();
+    const double time_step = settings.time_step;
+    const int step_count = std::round((t_prm.tf - t0) / time_step);
+    if (step_count <= 0)
+        {
+        std::cout << "Nothing to integrate before the final time.\n";
+        return 0;
+        }
+    const int N = std::min(settings.pararealSlices, step_count);
+
+    // the slices are built one after the other: reading a mesh is not thread safe
+    std::vector<Slice> slices(N);
+    for (int n = 0; n < N; n++)
+        {
+        Slice &slice = slices[n];
+        slice.first = n * step_count / N;
+        slice.last = (n + 1) * step_count / N;
+        slice.settings = sliceSettings(settings, N);
+        slice.settings->setSeed(settings.drawSeed());
+        timing t_slice(settings.tf, settings.dt_min, settings.dt_max);
+        slice.fem = std::make_unique<Fem>(*slice.settings, t_slice);
+        slice.linAlg = std::make_unique<LinAlgebra>(*slice.settings, slice.fem->msh);
+        slice.demagSol = makeDemagSolver(*slice.settings, slice.fem->msh);
+        slice.outputs.resize(slice.last - slice.first);
+        slice.dt.resize(slice.last - slice.first);
+        }
+    std::cout << "Parareal integration over " << N << " slices of " << step_count / N
+              << (step_count % N ? "+" : "") << " output steps\n";
+
+    // U[n]: state at the start of slice n, G[n]: coarse propagation of U[n] over slice n
+    // U[0] is saved as the first output: it needs its demag potentials
+    std::vector<State> U(N + 1), G(N);
+    demagSol.calc_demag(fem.msh);
+    fem.msh.getState(Nodes::NEXT, U[0]);
+    nt = 0;
+    int nt_coarse(0);
+    for (int n = 0; n < N; n++)
+        {
+        if (coarsePass(fem, settings, linAlg, demagSol, U[n], t0, time_step, slices[n].first,
+                       slices[n].last, G[n], nt_coarse))
+            {
+            std::cout << "\n**ABORTED**: coarse propagation of slice " << n << " failed\n";
+            return 1;
+            }
+        U[n + 1] = G[n];
+        }
+
+    // after iteration k, the slices up to k start from the exact state: they are not computed again
+    int status(0);
+    const int NOD = fem.msh.getNbNodes();
+    for (int k = 0;; k++)
+        {
+        std::vector<int> todo(N - k);
+        std::iota(todo.begin(), todo.end(), k);
+        std::for_each(EXEC_POL, todo.begin(), todo.end(),
+                      [&](int n) { finePass(slices[n], U[n], t0, time_step); });
+        for (int n = k; n < N; n++)
+            {
+            nt += slices[n].nt;
+            if (slices[n].status)
+                {
+                std::cout << "\n**ABORTED**: fine propagation of slice " << n << " failed\n";
+                return 1;
+                }
+            }
+        if (k == N - 1) break;  // all the slices started from the exact state
+
+        double diff(0);
+        State Gnew;
+        for (int n = k; n < N; n++)
+            {
+            State const &F = slices[n].outputs.back();
+            if (n == k)
+                Gnew = G[n];  // U[k] did not change
+            else if (coarsePass(fem, settings, linAlg, demagSol, U[n], t0, time_step,
+                                slices[n].first, slices[n].last, Gnew, nt_coarse))
+                {
+                std::cout << "\n**ABORTED**: coarse propagation of slice " << n << " failed\n";
+                return 1;
+                }
+            State &Unext = U[n + 1];
+            for (int i = 0; i < NOD; i++)
+                {
+                Eigen::Vector3d u = Gnew[i].u + F[i].u - G[n][i].u;
+                u.normalize();
+                diff = std::max(diff, (u - Unext[i].u).norm());
+                Unext[i] = F[i];
+                Unext[i].u = u;
+                }
+            G[n] = Gnew;
+            }
+        std::cout << "parareal iteration " << k + 1 << ": max|du| = " << diff << std::endl;
+        if (diff < settings.pararealTol) break;
+        if (k + 1 == settings.pararealMaxIter)
+            {
+            std::cout << "WARNING: parareal iterations not converged, saving the last fine pass.\n";
+            status = 1;
+            break;
+            }
+        }
+    std::cout << "fine time steps: " << nt << ", coarse time steps: " << nt_coarse << "\n";
+
+    // write the trajectory of the last fine pass through the same path as the dynamics mode
+    std::string str = settings.r_path_output_dir + '/' + settings.getSimName() + ".evol";
+    std::ofstream fout(str);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << str << std::endl;
+        SYSTEM_ERROR;
+        }
+    fout << settings.evolMetadata();
+    fout.precision(16);
+    auto save = [&](State const &state, const double t, const double dt, const int nt_output)
+        {
+        fem.msh.setState(Nodes::CURRENT, state);
+        fem.msh.setState(Nodes::NEXT, state);
+        timing t_out(t_prm);
+        t_out.set_t(t);
+        t_out.set_dt(dt);
+        fem.energy(t, settings);
+        fem.saver(settings, t_out, fout, nt_output);
+        };
+    save(U[0], t0, t_prm.get_dt(), 0);
+    for (Slice const &slice : slices)
+        for (unsigned int j = 0; j < slice.outputs.size(); j++)
+            save(slice.outputs[j], t0 + (slice.first + j + 1) * time_step, slice.dt[j],
+                 slice.first + j + 1);
+    fout.close();
+    t_prm.set_t(t0 + step_count * time_step);
+    return status;
+    }
@@ -0,0 +1,65 @@
+#ifndef philox_h
+#define philox_h
+
+/** \file philox.h
+\brief counter-based random number generator Philox4x32-10 (Salmon et al., "Parallel random
+numbers: as easy as 1, 2, 3", SC11). The random numbers are a pure function of a counter and a key,
+so that they can be drawn in any order, by any thread, with the same results.
+*/
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include <eigen3/Eigen/Dense>
+
+namespace Philox
+    {
+/** counter of the generator, 128 bits */
+using counter = std::array<uint32_t, 4>;
+
+/** key of the generator, 64 bits */
+using key = std::array<uint32_t, 2>;
+
+const uint32_t M0 = 0xD2511F53; /**< multiplier of the first round function */
+const uint32_t M1 = 0xCD9E8D57; /**< multiplier of the second round function */
+const uint32_t W0 = 0x9E3779B9; /**< first Weyl constant of the key schedule (golden ratio) */
+const uint32_t W1 = 0xBB67AE85; /**< second Weyl constant of the key schedule (sqrt(3) - 1) */
+const int ROUNDS = 10;          /**< number of rounds */
+
+/** \return the 128 random bits of counter ctr under key k */
+inline counter philox4x32(counter ctr, key k)
+    {
+    for (int r = 0; r < ROUNDS; r++)
+        {
+        if (r > 0)
+            {
+            k[0] += W0;
+            k[1] += W1;
+            }
+        const uint64_t p0 = uint64_t(M0) * ctr[0];
+        const uint64_t p1 = uint64_t(M1) * ctr[2];
+        ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ k[0], uint32_t(p1), uint32_t(p0 >> 32) ^ ctr[3] ^ k[1],
+               uint32_t(p0)};
+        }
+    return ctr;
+    }
+
+/** \return x mapped to a uniform number in (0, 1] */
+inline double uniform(const uint32_t x) { return (x + 1.0) * 0x1p-32; }
+
+/** \return a vector of three independent standard normal numbers, drawn by the Box-Muller
+ * transform from the counter (index, step) under the key seed */
+inline Eigen::Vector3d normal3(const uint64_t seed, const uint64_t step, const uint32_t index)
+    {
+    const counter r = philox4x32({index, uint32_t(step), uint32_t(step >> 32), 0},
+                                 {uint32_t(seed), uint32_t(seed >> 32)});
+    const double rho0 = sqrt(-2 * log(uniform(r[0])));
+    const double rho1 = sqrt(-2 * log(uniform(r[2])));
+    const double theta0 = 2 * M_PI * uniform(r[1]);
+    const double theta1 = 2 * M_PI * uniform(r[3]);
+    return Eigen::Vector3d(rho0 * cos(theta0), rho0 * sin(theta0), rho1 * cos(theta1));
+    }
+    }  // namespace Philox
+
+#endif /* philox_h */
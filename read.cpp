@@ -9,12 +9,12 @@
 
 namespace Mesh
     {
-void mesh::readMesh(Settings const &mySets)
+void mesh::readMesh(Settings const &mySets, std::string const &fileName)
     {
     gmsh::initialize();
     if (!mySets.verbose)
         { gmsh::option::setNumber("General.Terminal",0); } // to silent gmsh
-    checkMeshFile(mySets);
+    checkMeshFile(mySets, fileName);
     if (mySets.verbose)
         { std::cout<< "Checking mesh file: done.\n"; }
     readNodes(mySets);
@@ -32,14 +32,14 @@ void mesh::readMesh(Settings const &mySets)
     gmsh::finalize();
     }
 
-void mesh::checkMeshFile(Settings const &mySets)
+void mesh::checkMeshFile(Settings const &mySets, std::string const &fileName)
     {
     using namespace tags::msh;
-    gmsh::open(mySets.getPbName());
+    gmsh::open(fileName);
     
     bool msh_available = (gmsh::model::getDimension() == DIM_OBJ_3D);
     if (!msh_available)
-        { std::cout<<"Fatal Error: mesh file " << mySets.getPbName() << " is not 3D\n"; exit(1); }
+        { std::cout<<"Fatal Error: mesh file " << fileName << " is not 3D\n"; exit(1); }
     std::vector<int> elemTypes;
     gmsh::model::mesh::getElementTypes(elemTypes, DIM_OBJ_3D, -1);
     msh_available = msh_available && (elemTypes.size() == 1); // only one type of 3D element allowed
@@ -173,3 +173,27 @@ bool Mesh::mesh::savesol(const int precision, const std::string fileName,
     fout.close();
     return !(fout.good());
     }
+
+void Mesh::mesh::savesol(const int precision, const std::string fileName,
+                         std::string const &metadata, std::vector<Eigen::Vector3d> const &re,
+                         std::vector<Eigen::Vector3d> const &im) const
+    {
+    ofstream fout(fileName, ios::out);
+    if (fout.fail())
+        {
+        std::cout << "cannot open file " << fileName << std::endl;
+        SYSTEM_ERROR;
+        }
+
+    fout << metadata << std::scientific << std::setprecision(precision);
+
+    Eigen::IOFormat outputSolFmt(precision, Eigen::DontAlignCols, "\t", "\t", "", "", "", "");
+    for (unsigned int i = 0; i < node.size(); i++)
+        {
+        const int k = node_index[i];
+        fout << i << '\t' << re[k].format(outputSolFmt) << '\t' << im[k].format(outputSolFmt)
+             << endl;
+        }
+
+    fout.close();
+    }
@@ -13,6 +13,7 @@ namespace tags
         const std::string time = "## time:";
         const std::string rw_time = "## real-world time:";
         const std::string columns = "## columns:";
+        const std::string stopped = "## stopped:";
         }
     
     namespace evol
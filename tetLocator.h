@@ -0,0 +1,144 @@
+#ifndef tetLocator_h
+#define tetLocator_h
+
+/** \file tetLocator.h
+\brief point location in a tetrahedral mesh, through a uniform grid of buckets of tetrahedrons. The
+queries only read the grid, so they can be made concurrently.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "tetra.h"
+
+/** \class TetLocator
+uniform grid over the bounding box of the nodes, each cell holding the tetrahedrons whose bounding
+box overlaps it. The cells are about the size of a tetrahedron.
+*/
+class TetLocator
+    {
+public:
+    /** constructor: registers the tetrahedrons in the cells */
+    TetLocator(std::vector<Tetra::Tet> const &_tet /**< [in] */,
+               std::vector<Nodes::Node> const &_node /**< [in] */)
+        : tet(_tet), node(_node)
+        {
+        lower = Eigen::Vector3d::Constant(INFINITY);
+        Eigen::Vector3d upper = Eigen::Vector3d::Constant(-INFINITY);
+        for (Tetra::Tet const &te : tet)
+            for (int i = 0; i < Tetra::N; i++)
+                {
+                lower = lower.cwiseMin(node[te.ind[i]].p);
+                upper = upper.cwiseMax(node[te.ind[i]].p);
+                }
+        const Eigen::Vector3d l = (upper - lower).cwiseMax(1e-300);
+        const double h = std::cbrt(l.prod() / std::max<size_t>(tet.size(), 1));
+        for (int d = 0; d < Nodes::DIM; d++)
+            {
+            nb[d] = std::max(1, std::min(int(ceil(l(d) / h)), 1024));
+            h_d(d) = l(d) / nb[d];
+            }
+        cell.resize(nb[0] * nb[1] * nb[2]);
+        for (unsigned int t = 0; t < tet.size(); t++)
+            {
+            Eigen::Vector3d a = node[tet[t].ind[0]].p, b = a;
+            for (int i = 1; i < Tetra::N; i++)
+                {
+                a = a.cwiseMin(node[tet[t].ind[i]].p);
+                b = b.cwiseMax(node[tet[t].ind[i]].p);
+                }
+            Eigen::Vector3i ia = coords(a), ib = coords(b);
+            for (int x = ia(0); x <= ib(0); x++)
+                for (int y = ia(1); y <= ib(1); y++)
+                    for (int z = ia(2); z <= ib(2); z++)
+                        cell[index(x, y, z)].push_back(t);
+            }
+        }
+
+    /** \return the index of the tetrahedron containing p, and in lambda the barycentric coordinates
+     * of p. If p is outside the mesh, e.g. on a curved boundary discretized differently by another
+     * mesh, the closest tetrahedron is chosen and lambda is clamped on its faces. */
+    int locate(Eigen::Vector3d const &p /**< [in] */,
+               Eigen::Ref<Eigen::Vector4d> lambda /**< [out] */) const
+        {
+        const Eigen::Vector3i c = coords(p);
+        int best(-1);
+        double best_dist(INFINITY);
+        // a tetrahedron containing p is in the cell of p, otherwise the closest one is looked for
+        // in the rings of cells around it, up to one ring beyond the first candidate
+        int last = std::max({nb[0], nb[1], nb[2]});
+        for (int r = 0; r <= last; r++)
+            {
+            for (int x = c(0) - r; x <= c(0) + r; x++)
+                for (int y = c(1) - r; y <= c(1) + r; y++)
+                    for (int z = c(2) - r; z <= c(2) + r; z++)
+                        {
+                        if (std::max({abs(x - c(0)), abs(y - c(1)), abs(z - c(2))}) != r) continue;
+                        if (x < 0 || y < 0 || z < 0 || x >= nb[0] || y >= nb[1] || z >= nb[2])
+                            continue;
+                        for (int t : cell[index(x, y, z)])
+                            {
+                            Eigen::Vector4d l = barycentric(t, p);
+                            if (l.minCoeff() >= -1e-12)
+                                {
+                                lambda = l;
+                                return t;
+                                }
+                            l = l.cwiseMax(0);
+                            l /= l.sum();
+                            Eigen::Vector3d q = Eigen::Vector3d::Zero();
+                            for (int i = 0; i < Tetra::N; i++)
+                                q += l(i) * node[tet[t].ind[i]].p;
+                            const double dist = (q - p).norm();
+                            if (dist < best_dist)
+                                {
+                                best_dist = dist;
+                                best = t;
+                                lambda = l;
+                                }
+                            }
+                        }
+            if (best >= 0) last = std::min(last, r + 1);
+            }
+        return best;
+        }
+
+private:
+    /** \return the barycentric coordinates of p in tetrahedron t */
+    Eigen::Vector4d barycentric(const int t, Eigen::Vector3d const &p) const
+        {
+        const Eigen::Vector3d p0 = node[tet[t].ind[0]].p;
+        Eigen::Matrix3d M;
+        for (int i = 0; i < 3; i++)
+            M.col(i) = node[tet[t].ind[i + 1]].p - p0;
+        Eigen::Vector3d l = M.partialPivLu().solve(p - p0);
+        return Eigen::Vector4d(1 - l.sum(), l(0), l(1), l(2));
+        }
+
+    /** \return the coordinates of the cell of p, clamped to the grid */
+    Eigen::Vector3i coords(Eigen::Vector3d const &p) const
+        {
+        Eigen::Vector3i c;
+        for (int d = 0; d < Nodes::DIM; d++)
+            c(d) = std::clamp(int(floor((p(d) - lower(d)) / h_d(d))), 0, nb[d] - 1);
+        return c;
+        }
+
+    /** \return the index of cell (x, y, z) */
+    inline int index(const int x, const int y, const int z) const
+        {
+        return (z * nb[1] + y) * nb[0] + x;
+        }
+
+    std::vector<Tetra::Tet> const &tet;   /**< tetrahedrons */
+    std::vector<Nodes::Node> const &node; /**< nodes of the tetrahedrons */
+    Eigen::Vector3d lower;               /**< lower corner of the bounding box */
+    Eigen::Vector3d h_d;                 /**< size of the cells along each axis */
+    int nb[Nodes::DIM];                  /**< number of cells along each axis */
+    std::vector<std::vector<int>> cell;  /**< tetrahedrons of each cell */
+    };
+
+#endif
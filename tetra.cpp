@@ -127,7 +127,8 @@ Eigen::Matrix<double,NPI,1> Tet::calc_aniso_cub(Eigen::Ref<const Eigen::Vector3d
 
 void Tet::integrales(Tetra::prm const &param, timing const &prm_t,
                      std::function<void( Eigen::Ref<Eigen::Matrix<double,DIM,NPI>> Hext )> calc_Hext,//Eigen::Vector3d const &Hext,
-                     Nodes::index idx_dir, double Vdrift)
+                     Nodes::index idx_dir, double Vdrift, const double T,
+                     Eigen::Ref<const Eigen::Vector3d> eta)
     {
     const double alpha = param.alpha_LLG;
     const double Js = param.J;
@@ -196,6 +197,10 @@ void Tet::integrales(Tetra::prm const &param, timing const &prm_t,
         }
 
     Eigen::Matrix<double,DIM,NPI> H = Hext + H_aniso + Hd + (s_dt / gamma0) * Hv;
+    if (T > 0)
+        { // Brown's thermal field, the sum of the weights is the volume
+        H.colwise() += sqrt(2.0 * alpha * BOLTZMANN_KB * T / (gamma0 * Js * weight.sum() * dt)) * eta;
+        }
     
     for (int npi = 0; npi < NPI; npi++)
         {
@@ -293,6 +298,43 @@ double Tet::zeemanEnergy(Tetra::prm const &param, Eigen::Ref<Eigen::Vector3d> co
     return -param.J*weight.dot(dens);
     }
 
+void Tet::energyGradient(Tetra::prm const &param, Eigen::Ref<const Eigen::Vector3d> Hext,
+                         Eigen::Ref<Eigen::Matrix<double,DIM,N>> G) const
+    {
+    Eigen::Matrix<double,DIM,NPI> U,dUdx,dUdy,dUdz;
+    interpolation(Nodes::get_u<NEXT>, U, dUdx, dUdy, dUdz);
+    Eigen::Matrix<double,NPI,1> phi;
+    interpolation(Nodes::get_phi<NEXT>, phi);
+
+    // zeeman and anisotropy contributions, on the Gauss points
+    Eigen::Matrix<double,DIM,NPI> H = (param.J * Hext).replicate(1,NPI);
+    for (int npi = 0; npi < NPI; npi++)
+        {
+        Eigen::Vector3d m = U.col(npi);
+        if (param.K != 0)
+            { H.col(npi) += 2.0 * param.K * param.uk.dot(m) * param.uk; }
+        if (param.K3 != 0)
+            {
+            double al0 = m.dot(param.ex);
+            double al1 = m.dot(param.ey);
+            double al2 = m.dot(param.ez);
+            H.col(npi) -= 2.0 * param.K3 * (al0 * (sq(al1) + sq(al2)) * param.ex
+                                            + al1 * (sq(al0) + sq(al2)) * param.ey
+                                            + al2 * (sq(al0) + sq(al1)) * param.ez);
+            }
+        }
+
+    for (int npi = 0; npi < NPI; npi++)
+        {
+        const double w = weight[npi];
+        for (int i = 0; i < N; i++)
+            {
+            G.col(i) -= w*2.0*param.A*(da(i,0)*dUdx.col(npi) + da(i,1)*dUdy.col(npi) + da(i,2)*dUdz.col(npi));
+            G.col(i) += w*(a[i][npi]*H.col(npi) + param.J*phi[npi]*da.row(i).transpose());
+            }
+        }
+    }
+
 double Tet::Jacobian(Eigen::Ref<Eigen::Matrix3d> J)
     {
     Eigen::Vector3d p0p1 = getNode(1).p - getNode(0).p;
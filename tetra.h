@@ -74,6 +74,7 @@ struct prm
     Eigen::Vector3d ey; /**< unit vector2 (for cubic anisotropy) */
     Eigen::Vector3d ez; /**< unit vector3 (for cubic anisotropy) */
     STT p_STT;   /**< spin transfert torque (thiaville STT) parameters */
+    bool frozen; /**< magnetization held fixed in all the simulation modes */
 
     /** print the struct parameters */
     inline void infos()
@@ -265,11 +266,14 @@ public:
                                                Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,NPI>> V,
                                                Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,NPI>> H_aniso) const;
 
-    /** computes the integral contribution of the tetrahedron to the evolution of the magnetization
-     */
+    /** computes the integral contribution of the tetrahedron to the evolution of the magnetization.
+     * If T > 0, the thermal fluctuation field of the tetrahedron is eta scaled by its standard
+     * deviation \f$ \sqrt{2 \alpha k_B T / (\gamma_0 J_s V dt)} \f$ */
     void integrales( Tetra::prm const &param, timing const &prm_t,
                     std::function<void( Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,NPI>> Hext )> calc_Hext,
-                    Nodes::index idx_dir, double Vdrift);
+                    Nodes::index idx_dir, double Vdrift,
+                    const double T /**< [in] temperature */,
+                    Eigen::Ref<const Eigen::Vector3d> eta /**< [in] standard normal vector */);
 
     /** exchange energy of the tetrahedron */
     double exchangeEnergy(Tetra::prm const &param,
@@ -297,6 +301,12 @@ public:
     double zeemanEnergy(Tetra::prm const &param, Eigen::Ref<Eigen::Vector3d> const Hext,
                         Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,NPI>> const u) const;
 
+    /** adds to G the opposite of the gradient of the energy of the tetrahedron (exchange,
+     * anisotropy, demag and zeeman, as computed by the energy functions above) with respect to the
+     * magnetization of its nodes, on the NEXT step, column i for node i */
+    void energyGradient(Tetra::prm const &param, Eigen::Ref<const Eigen::Vector3d> Hext,
+                        Eigen::Ref<Eigen::Matrix<double,Nodes::DIM,N>> G) const;
+
     /** \return \f$ |J| \f$ build Jacobian \f$ J \f$ */
     double Jacobian(Eigen::Ref<Eigen::Matrix3d> J);
 
@@ -6,26 +6,31 @@
 #include "fem.h"
 #include "time_integration.h"
 #include "chronometer.h"
-#include "fmm_demag.h"
+#include "demagSolver.h"
 #include "linear_algebra.h"
 #include "log-stats.h"
+#include "tags.h"
 
 /** Logic for finding a reasonable time step. */
 class TimeStepper
     {
     const double hard_min; /**< never go below **/
     const double hard_max; /**< never exceed **/
+    const double growth;   /**< growth factor of soft_max on each step */
     double soft_max;       /**< too large for this specific time step */
 public:
     /** Create a TimeStepper initialized with the given initial and maximum time steps. */
-    TimeStepper(double initial, double min, double max)
-        : hard_min(min), hard_max(max * (1 + FLT_EPSILON)), soft_max(initial)
+    TimeStepper(double initial, double min, double max, double _growth = 1.1)
+        : hard_min(min), hard_max(max * (1 + FLT_EPSILON)), growth(_growth), soft_max(initial)
         {
         }
 
     /** Update soft_max to be no larger than max. */
     void set_soft_limit(double max) { soft_max = std::min(soft_max, max); }
 
+    /** Set soft_max to the time step predicted by a controller, within the hard limits. */
+    void set_prediction(double dt) { soft_max = std::clamp(dt, hard_min, hard_max); }
+
     /** Return a reasonable time step. `stride' is distance to the next
      * time we want to hit exactly. */
     double operator()(double stride)
@@ -35,22 +40,403 @@ public:
             {
             step = stride - 2 * hard_min;
             }
-        soft_max = std::max(soft_max, std::min(step * 1.1, hard_max));
+        soft_max = std::max(soft_max, std::min(step * growth, hard_max));
         return step;
         }
     };
 
+/** Proportional-integral time step controller (Gustafsson). The local error of a step is estimated
+ * by the distance between the magnetization computed by the theta scheme, u + dt v, and the
+ * predictor extrapolated with the speed of the last accepted step, u + dt v_prev. Normalized by the
+ * tolerance, the step is accepted if the error is at most one, and the next time step is predicted
+ * from the errors of the last two accepted steps. */
+class PIController
+    {
+    const double tol;   /**< tolerance on the local error */
+    double err_prev;    /**< normalized error of the last accepted step */
+
+    static constexpr double order = 2;       /**< the error estimate is O(dt^2) */
+    static constexpr double k_I = 0.7 / order; /**< integral gain */
+    static constexpr double k_P = 0.4 / order; /**< proportional gain */
+    static constexpr double safety = 0.9;    /**< safety factor */
+    static constexpr double min_factor = 0.2; /**< largest reduction of the time step */
+    static constexpr double max_factor = 2;   /**< largest increase of the time step */
+
+public:
+    /** Create a PIController with the tolerance on the local error. */
+    explicit PIController(double _tol) : tol(_tol), err_prev(1) {}
+
+    /** Return the normalized local error estimate of the step of duration dt just solved. */
+    double estimate(Mesh::mesh const &msh, const double dt) const
+        {
+        double err(0);
+        for (int i = 0; i < msh.getNbNodes(); i++)
+            err = std::max(err, (msh.getNode_v(i) - msh.getNode_v_prev(i)).norm());
+        return dt * err / tol;
+        }
+
+    /** Return the ratio of the next time step to the time step of a step of normalized error
+     * err. The step is accepted if err <= 1. */
+    double factor(const double err) const
+        {
+        double f;
+        if (err > 1)
+            f = safety * std::pow(err, -1 / order);
+        else if (err == 0)
+            f = max_factor;
+        else
+            f = safety * std::pow(err, -k_I) * std::pow(err_prev, k_P);
+        return std::clamp(f, min_factor, max_factor);
+        }
+
+    /** Record the normalized error err of an accepted step, for the proportional term. */
+    void accept(const double err)
+        {
+        if (err > 0) err_prev = std::max(err, 1e-4);
+        }
+    };
+
+/** Logic for recomputing the demag potentials only on some of the time steps. In between, the
+ * potentials are linearly extrapolated in time from their last two computations. */
+class DemagSubCycling
+    {
+    const int every;      /**< refresh every `every` updates, 0 to disable */
+    const double max_du;  /**< refresh when max|u - u_ref| exceeds max_du, 0 to disable */
+    int steps;            /**< updates since the last refresh */
+    int nb_eval;          /**< number of stored computations, at most two */
+    double t;             /**< time of the current state, relative to the first update */
+    double t_prev;        /**< time of the computation before the last one */
+    double t_last;        /**< time of the last computation */
+    std::vector<Eigen::Vector3d> u_ref; /**< magnetization at the last computation */
+    std::vector<double> phi_prev;       /**< phi at time t_prev */
+    std::vector<double> phiv_prev;      /**< phiv at time t_prev */
+    std::vector<double> phi_last;       /**< phi at time t_last */
+    std::vector<double> phiv_last;      /**< phiv at time t_last */
+
+public:
+    /** Create a DemagSubCycling with the refresh criteria. */
+    DemagSubCycling(int _every, double _max_du)
+        : every(_every), max_du(_max_du), steps(0), nb_eval(0), t(0), t_prev(0), t_last(0)
+        {
+        }
+
+    /** Forget the stored computations: the next update will recompute the potentials. */
+    void reset(void) { nb_eval = 0; }
+
+    /** Recompute or extrapolate the potentials of the NEXT state of msh, `dt' is the time elapsed
+     * since the previous update. Returns true if the potentials were recomputed. */
+    bool update(Mesh::mesh &msh, demagSolver &demagSol, const double dt)
+        {
+        const int NOD = msh.getNbNodes();
+        t += dt;
+        steps++;
+        bool refresh = (nb_eval == 0) || (every > 0 && steps >= every);
+        if (!refresh && max_du > 0)
+            {
+            double du = 0;
+            for (int i = 0; i < NOD; i++)
+                du = std::max(du, (msh.getNode_u(i) - u_ref[i]).norm());
+            refresh = (du > max_du);
+            }
+
+        if (refresh)
+            {
+            demagSol.calc_demag(msh);
+            std::swap(phi_prev, phi_last);
+            std::swap(phiv_prev, phiv_last);
+            phi_last.resize(NOD);
+            phiv_last.resize(NOD);
+            u_ref.resize(NOD);
+            for (int i = 0; i < NOD; i++)
+                {
+                phi_last[i] = msh.get(i, Nodes::get_phi<Nodes::NEXT>);
+                phiv_last[i] = msh.get(i, Nodes::get_phiv<Nodes::NEXT>);
+                u_ref[i] = msh.getNode_u(i);
+                }
+            t_prev = t_last;
+            t_last = t;
+            nb_eval = std::min(nb_eval + 1, 2);
+            steps = 0;
+            }
+        else
+            set_potentials(msh);
+        return refresh;
+        }
+
+    /** Extrapolate the potentials of the NEXT state of msh, `dt' is the time elapsed since the
+     * previous update, whatever the refresh criteria. The potentials are left as they are if there
+     * is no stored computation. */
+    void extrapolate(Mesh::mesh &msh, const double dt)
+        {
+        t += dt;
+        if (nb_eval > 0) set_potentials(msh);
+        }
+
+private:
+    /** set the potentials of the NEXT state of msh, extrapolated at time t */
+    void set_potentials(Mesh::mesh &msh) const
+        {
+        const double c = (nb_eval == 2 && t_last > t_prev) ? (t - t_last) / (t_last - t_prev) : 0;
+        for (int i = 0; i < msh.getNbNodes(); i++)
+            {
+            double phi = phi_last[i];
+            double phiv = phiv_last[i];
+            if (c != 0)
+                {
+                phi += c * (phi_last[i] - phi_prev[i]);
+                phiv += c * (phiv_last[i] - phiv_prev[i]);
+                }
+            msh.set(i, Nodes::set_phi, phi);
+            msh.set(i, Nodes::set_phiv, phiv);
+            }
+        }
+    };
+
+/** Dense output: the outputs at a time between two accepted time steps are computed on the
+ * magnetization and potentials linearly interpolated between them. */
+class DenseOutput
+    {
+    double t_prev = 0;                   /**< time at the beginning of the last accepted step */
+    std::vector<Nodes::dataNode> prev;   /**< state at t_prev */
+    std::vector<Nodes::dataNode> last;   /**< state at the end of the last accepted step */
+    std::vector<Nodes::dataNode> interp; /**< interpolated state */
+
+public:
+    /** Store the state at the beginning of an accepted step starting at t, i.e. the CURRENT step of
+     * msh, before it is overwritten. */
+    void store(Mesh::mesh const &msh, const double t)
+        {
+        t_prev = t;
+        msh.getState(Nodes::CURRENT, prev);
+        }
+
+    /** Call output with the NEXT step of msh holding the state interpolated at t_out, between the
+     * stored state and the current one, at time t. The current state is restored afterwards. */
+    void interpolate(Mesh::mesh &msh, const double t_out, const double t,
+                     std::function<void(void)> output)
+        {
+        msh.getState(Nodes::NEXT, last);
+        const double s = (t_out - t_prev) / (t - t_prev);
+        interp.resize(last.size());
+        for (unsigned int i = 0; i < last.size(); i++)
+            {
+            interp[i].u = ((1 - s) * prev[i].u + s * last[i].u).normalized();
+            interp[i].v = (1 - s) * prev[i].v + s * last[i].v;
+            interp[i].phi = (1 - s) * prev[i].phi + s * last[i].phi;
+            interp[i].phiv = (1 - s) * prev[i].phiv + s * last[i].phiv;
+            }
+        msh.setState(Nodes::NEXT, interp);
+        output();
+        msh.setState(Nodes::NEXT, last);
+        }
+    };
+
+/** Detection of the equilibrium: the integration stops when all the enabled criteria of
+ * time_integration.stop_when are met on a number of consecutive accepted steps. */
+class EquilibriumDetector
+    {
+    int count = 0;                  /**< consecutive accepted steps meeting the criteria */
+    double E_prev = NAN;            /**< total energy at the previous accepted step */
+    std::vector<Eigen::Vector3d> H; /**< effective field, for the torque */
+    std::vector<bool> frozen;       /**< nodes left out of the torque, built on the first check */
+
+public:
+    std::string reason; /**< why the integration stopped, empty if it did not */
+
+    /** Check the criteria on the state at time t, after an accepted step. Returns true if the
+     * integration should stop. */
+    bool check(Fem &fem, Settings &settings, const double t)
+        {
+        if (!settings.stopAtEquilibrium()) return false;
+        std::ostringstream ss;
+        ss.precision(3);
+        bool met = true;
+        if (settings.stopTorque > 0)
+            {
+            if (frozen.empty()) frozen = fem.msh.frozenNodes(settings.paramTetra);
+            fem.effectiveField(t, settings, H);
+            double torque(0);
+            for (int i = 0; i < fem.msh.getNbNodes(); i++)
+                if (!frozen[i])
+                    torque = std::max(torque, mu0 * fem.msh.getNode_u(i).cross(H[i]).norm());
+            met = met && (torque < settings.stopTorque);
+            ss << "max(torque) = " << torque << " T < " << settings.stopTorque << " T, ";
+            }
+        if (settings.stopVmax > 0)
+            {
+            met = met && (fem.vmax < settings.stopVmax);
+            ss << "max(v) = " << fem.vmax << " < " << settings.stopVmax << " /s, ";
+            }
+        if (settings.stopEnergyChange > 0)
+            {
+            if (settings.denseOutput && !settings.verbose)
+                fem.energy(t, settings);  // skipped by compute_all()
+            const double dE = fabs(fem.Etot - E_prev) / std::max(fabs(fem.Etot), DBL_MIN);
+            met = met && (dE < settings.stopEnergyChange);  // false on the first step, dE is NaN
+            E_prev = fem.Etot;
+            ss << "relative energy change = " << dE << " < " << settings.stopEnergyChange << ", ";
+            }
+        count = met ? count + 1 : 0;
+        if (count < settings.stopSteps) return false;
+        ss << "on " << count << " consecutive time steps";
+        reason = ss.str();
+        return true;
+        }
+    };
+
 /** Summary statistics on the time steps. */
 struct Stats
     {
     LogStats good_dt;    /**< dt of successful steps */
     LogStats good_dumax; /**< dumax of successful steps */
     LogStats bad_dt;     /**< dt of failed steps */
+    LogStats error;      /**< normalized local error estimate of successful steps */
+    long rejected_solver = 0;   /**< steps rejected because the solver failed */
+    long rejected_dumax = 0;    /**< steps rejected because dumax exceeded DUMAX */
+    long rejected_error = 0;    /**< steps rejected by the error estimate */
+    long demag_refresh = 0;      /**< number of computations of the demag potentials */
+    long demag_extrapolated = 0; /**< number of extrapolations of the demag potentials */
+    long dofs_solved = 0;  /**< degrees of freedom solved, summed over the successful steps */
+    long dofs_total = 0;   /**< degrees of freedom of the mesh, summed over the successful steps */
+    long multirate_steps = 0; /**< successful steps whose fast nodes were sub-stepped */
+    };
+
+/** extend the marked nodes by `layers' layers of tetrahedrons */
+static void growHalo(Mesh::mesh const &msh, std::vector<bool> &marked, const int layers)
+    {
+    for (int h = 0; h < layers; h++)
+        {
+        std::vector<bool> grown(marked);
+        for (Tetra::Tet const &te : msh.tet)
+            {
+            bool touched(false);
+            for (int i = 0; i < Tetra::N; i++)
+                touched = touched || marked[te.ind[i]];
+            if (touched)
+                for (int i = 0; i < Tetra::N; i++)
+                    grown[te.ind[i]] = true;
+            }
+        marked.swap(grown);
+        }
+    }
+
+/** Logic for leaving out of the linear system the nodes that barely move. A node is idle when its
+ * speed, and optionally its torque, stayed below the thresholds on `steps' consecutive time steps,
+ * and it is not within `halo' layers of tetrahedrons of a moving node. The idle nodes are chosen
+ * every `window' accepted time steps, after a time step solving all the nodes, since the speed of
+ * an idle node is zero. */
+class ActiveSet
+    {
+    const double max_v;      /**< speed threshold in 1/s, 0 to disable the active set */
+    const double max_torque; /**< torque threshold in tesla, 0 to ignore the torque */
+    const int steps;         /**< steps below the thresholds before a node gets idle */
+    const int window;        /**< steps between two choices of the idle nodes */
+    const int halo;          /**< layers of tetrahedrons solved around the moving nodes */
+    int count = 0;           /**< accepted steps since the last choice */
+    bool any_idle = false;   /**< true if some nodes are left out */
+    double E_prev = NAN;     /**< total energy at the previous accepted step */
+    std::vector<int> quiet;  /**< consecutive steps below the thresholds of each node */
+    std::vector<bool> idle;  /**< nodes left out of the linear system */
+    std::vector<Eigen::Vector3d> H; /**< effective field, for the torque */
+
+    /** relative increase of the total energy beyond rounding errors */
+    static constexpr double ENERGY_TOL = 1e-12;
+
+    /** mark as idle the quiet nodes outside of the halo of the moving ones */
+    void choose(Mesh::mesh const &msh)
+        {
+        const int NOD = msh.getNbNodes();
+        std::vector<bool> moving(NOD);
+        for (int i = 0; i < NOD; i++)
+            moving[i] = (quiet[i] < steps);
+        growHalo(msh, moving, halo);
+        any_idle = false;
+        for (int i = 0; i < NOD; i++)
+            {
+            idle[i] = !moving[i];
+            any_idle = any_idle || idle[i];
+            }
+        }
+
+public:
+    /** Create an ActiveSet with the thresholds of the settings. */
+    explicit ActiveSet(Settings const &settings)
+        : max_v(settings.activeSetVmax), max_torque(settings.activeSetTorque),
+          steps(settings.activeSetSteps), window(settings.activeSetWindow),
+          halo(settings.activeSetHalo)
+        {
+        }
+
+    /** Solve all the nodes again, which will have to stay quiet for `steps' steps again. */
+    void reset(LinAlgebra &linAlg)
+        {
+        if (max_v == 0) return;
+        std::fill(quiet.begin(), quiet.end(), 0);
+        std::fill(idle.begin(), idle.end(), false);
+        any_idle = false;
+        count = 0;
+        linAlg.setIdleNodes(std::vector<bool>());
+        }
+
+    /** Update the idle nodes after an accepted step, the state is at time t. */
+    void update(Fem &fem, Settings &settings, LinAlgebra &linAlg, Stats &stats, const double t)
+        {
+        stats.dofs_solved += linAlg.getNbDofs();
+        stats.dofs_total += fem.msh.getNbDofs();
+        if (max_v == 0) return;
+        const int NOD = fem.msh.getNbNodes();
+        if (quiet.empty())
+            {
+            quiet.assign(NOD, 0);
+            idle.assign(NOD, false);
+            }
+        if (max_torque > 0) fem.effectiveField(t, settings, H);
+        for (int i = 0; i < NOD; i++)
+            {
+            if (idle[i]) continue;
+            bool below = fem.msh.getNode_v(i).norm() < max_v;
+            if (below && max_torque > 0)
+                below = mu0 * fem.msh.getNode_u(i).cross(H[i]).norm() < max_torque;
+            quiet[i] = below ? quiet[i] + 1 : 0;
+            }
+
+        // without temperature, spin transfer torque and time dependent field (see Settings), the
+        // damping only decreases the energy: an increase signals a node held wrongly
+        if (settings.denseOutput && !settings.verbose)
+            fem.energy(t, settings);  // skipped by compute_all()
+        const bool increased = (fem.Etot - E_prev > ENERGY_TOL * fabs(E_prev));
+        E_prev = fem.Etot;
+        if (any_idle && increased)
+            {
+            if (settings.verbose)
+                std::cout << "active set: energy increased, solving all the nodes\n";
+            reset(linAlg);
+            return;
+            }
+
+        count++;
+        if (count == window - 1 && any_idle)
+            {  // the next step solves all the nodes, to measure their speed
+            linAlg.setIdleNodes(std::vector<bool>());
+            std::fill(idle.begin(), idle.end(), false);
+            any_idle = false;
+            }
+        else if (count >= window)
+            {
+            choose(fem.msh);
+            linAlg.setIdleNodes(idle);
+            count = 0;
+            if (settings.verbose)
+                std::cout << "active set: " << linAlg.getNbDofs() << " of " << fem.msh.getNbDofs()
+                          << " degrees of freedom solved\n";
+            }
+        }
     };
 
-static void print_stats(const Stats &s)
+static void print_stats(const Stats &s, const step_controller controller)
     {
-    puts("\nTime step statistics:\n");
+    printf("\nTime step statistics (%s controller):\n\n",
+           controller == PI_CONTROLLER ? "pi" : "heuristic");
     puts("    time steps       count       dt [*]          dumax [*]");
     puts("    ──────────────────────────────────────────────────────────");
     printf("    successful   %9g", (double) s.good_dt.count());
@@ -65,6 +451,20 @@ static void print_stats(const Stats &s)
     else
         puts("\n");
     puts("    [*] ranges given as (geometric mean) ± (relative stddev)");
+    const long nb_steps = s.good_dt.count() + s.bad_dt.count();
+    if (nb_steps != 0)
+        printf("\nRejected steps: %.1f%% (solver %ld, max(du) %ld, error estimate %ld)\n",
+               100.0 * s.bad_dt.count() / nb_steps, s.rejected_solver, s.rejected_dumax,
+               s.rejected_error);
+    if (s.error.count() != 0)
+        printf("Local error estimate of successful steps: %8.2e ± %4.2f [*] of error_tolerance\n",
+               s.error.mean(), s.error.stddev());
+    printf("\nDemag potentials: %ld computed, %ld extrapolated\n", s.demag_refresh,
+           s.demag_extrapolated);
+    if (s.dofs_solved < s.dofs_total)
+        printf("Degrees of freedom solved: %.1f%%\n", 100.0 * s.dofs_solved / s.dofs_total);
+    if (s.multirate_steps != 0)
+        printf("Multirate: %ld steps with sub-stepped fast nodes\n", s.multirate_steps);
     }
 
 /** Periodically show the percentage of work done, together with an
@@ -123,25 +523,272 @@ static void exit_if_signal_received(const Fem &fem, const Settings &settings, co
         }
     std::cout << "Terminating.\n";
 
-    print_stats(stats);
+    print_stats(stats, settings.stepController);
     exit(1);
     }
 
-/** compute all quantitites at time t */
-inline void compute_all(Fem &fem, Settings &settings, scal_fmm::fmm &myFMM, const double t)
+/** write the demag potential and field on the probes, one line per probe, positions in the length
+ * unit of the mesh, the block of each output step ends with an empty line */
+static void save_probes(Settings const &settings, const double t, demagSolver const &demagSol,
+                        std::ofstream &fout)
+    {
+    const std::vector<Eigen::Vector3d> probes = settings.getProbes();
+    for (unsigned int k = 0; k < probes.size(); k++)
+        {
+        Eigen::Vector3d p = probes[k] / settings.getScale();
+        Eigen::Vector3d const &H = demagSol.probeH[k];
+        fout << t << '\t' << p.x() << '\t' << p.y() << '\t' << p.z() << '\t' << demagSol.probePhi[k]
+             << '\t' << H.x() << '\t' << H.y() << '\t' << H.z() << '\n';
+        }
+    fout << std::endl;
+    }
+
+/** compute all quantitites at time t, `dt' is the time elapsed since the previous call. With dense
+ * output, the energies are only computed when an output is due, or for the verbose messages */
+inline void compute_all(Fem &fem, Settings &settings, demagSolver &demagSol,
+                        DemagSubCycling &demagCycle, Stats &stats, const double t, const double dt)
     {
     chronometer fmm_counter(2);
-    myFMM.calc_demag(fem.msh);
-    if (settings.verbose)
+    if (demagCycle.update(fem.msh, demagSol, dt))
+        {
+        stats.demag_refresh++;
+        if (settings.verbose)
             { std::cout << "magnetostatics done in " << fmm_counter.millis() << std::endl; }
-    fem.energy(t, settings);
+        }
+    else
+        {
+        stats.demag_extrapolated++;
+        if (settings.verbose)
+            { std::cout << "magnetostatics extrapolated in " << fmm_counter.millis() << std::endl; }
+        }
+    if (!settings.denseOutput || settings.verbose)
+        fem.energy(t, settings);
+    fem.evolution();
+    }
+
+/** Outcome of the attempt of a time step. */
+enum step_outcome
+    {
+    ACCEPTED,
+    REJECTED_SOLVER, ///< the solver failed
+    REJECTED_DUMAX,  ///< the variation of the magnetization exceeds the limit
+    REJECTED_ERROR   ///< the local error estimate exceeds the tolerance
+    };
+
+/** assemble and solve the linear system of the time step of duration t_prm.get_dt() from time
+ * t_prm.get_t(), the NEXT state of the nodes is updated on success. Returns the status of the
+ * solver. */
+static int solve_step(Settings &settings, LinAlgebra &linAlg, timing const &t_prm)
+    {
+    linAlg.base_projection();
+    if(settings.getFieldType() == RtoR3)
+        {
+        Eigen::Vector3d Hext = settings.getField(t_prm.get_t());
+        linAlg.prepareElements(Hext, t_prm);
+        }
+    else if(settings.getFieldType() == R4toR3)
+        {
+        double amp_field_time = settings.getFieldTime(t_prm.get_t());
+        linAlg.prepareElements(amp_field_time,t_prm);
+        }
+    return linAlg.solver(t_prm);
+    }
+
+/** solve the time step of duration t_prm.get_dt() from time t_prm.get_t(), and update the time step
+ * limits of the stepper. The variation of the magnetization is limited to dumax_limit. `first' is
+ * true on the first step, which has no previous speed for the error estimate. The memory of the
+ * controller is left to the caller, which accepts the error once the step is kept. */
+static step_outcome try_step(Fem &fem, Settings &settings, LinAlgebra &linAlg,
+                             timing const &t_prm, TimeStepper &stepper, PIController &controller,
+                             const double dumax_limit, const bool first, double &dumax,
+                             double &error)
+    {
+    int err = solve_step(settings, linAlg, t_prm);
+    fem.vmax = linAlg.get_v_max();
+
+    if (err)
+        {
+        stepper.set_soft_limit(t_prm.get_dt() / 2);
+        return REJECTED_SOLVER;
+        }
+
+    dumax = t_prm.get_dt() * fem.vmax;
+    // no previous speed to extrapolate on the first step
+    error = first ? 0 : controller.estimate(fem.msh, t_prm.get_dt());
+    if (settings.verbose)
+        {
+        std::cout << "  -> dumax = " << dumax << ",  vmax = " << fem.vmax
+                  << ",  error = " << error << std::endl;
+        }
+
+    const bool pi_control = (settings.stepController == PI_CONTROLLER);
+    if (pi_control)
+        {
+        stepper.set_prediction(t_prm.get_dt() * controller.factor(error));
+        stepper.set_soft_limit(dumax_limit / fem.vmax);
+        }
+    else
+        stepper.set_soft_limit(dumax_limit / fem.vmax / 2);
+    if (dumax > dumax_limit) return REJECTED_DUMAX;
+    if (pi_control && error > 1) return REJECTED_ERROR;
+    return ACCEPTED;
+    }
+
+/** Logic for multirate time steps: after the solve of a coarse step on all the nodes, the nodes
+ * whose variation exceeds DUMAX, with a halo of `halo' layers of tetrahedrons, are integrated again
+ * from the start of the step with `factor' sub-steps. The other nodes are held in the linear system
+ * of the sub-steps, and follow their coarse step linearly in time, so that the fast nodes see
+ * consistent values at the interface. Within the coarse step, the demag potentials are
+ * extrapolated in time, and the energies are only computed at its end, as for a plain step. */
+class MultiRate
+    {
+    const int factor; /**< sub-steps per coarse step, 1 to disable */
+    const int halo;   /**< layers of tetrahedrons of the fast region around the fast nodes */
+    std::vector<Nodes::dataNode> start; /**< state at the start of the coarse step */
+    std::vector<Nodes::dataNode> end;   /**< state at the end of the coarse step */
+    std::vector<bool> slow;             /**< nodes following the coarse step */
+    uint64_t thermal_start = 0;         /**< thermal step of the start of the coarse step */
+
+    /** go back to the start of the coarse step, and solve all the nodes again */
+    step_outcome fail(Fem &fem, LinAlgebra &linAlg, DemagSubCycling &demagCycle,
+                      const step_outcome outcome)
+        {
+        fem.msh.setState(Nodes::CURRENT, start);
+        fem.msh.setState(Nodes::NEXT, start);
+        demagCycle.reset();
+        linAlg.set_thermal_step(thermal_start);
+        linAlg.setIdleNodes(std::vector<bool>());
+        return outcome;
+        }
+
+public:
+    /** Create a MultiRate from the settings. */
+    explicit MultiRate(Settings const &settings)
+        : factor(settings.multirateFactor), halo(settings.multirateHalo)
+        {
+        }
+
+    /** \return the limit on the variation of the magnetization over a coarse step */
+    double coarse_dumax(const double dumax) const { return factor * dumax; }
+
+    /** sort the nodes after the solve of a coarse step of duration dt. Returns the number of fast
+     * nodes, 0 if the coarse step can be kept as it is. */
+    int split(Mesh::mesh const &msh, const double dt, const double dumax)
+        {
+        if (factor == 1) return 0;
+        const int NOD = msh.getNbNodes();
+        std::vector<bool> fast(NOD);
+        bool any_fast(false);
+        for (int i = 0; i < NOD; i++)
+            {
+            fast[i] = (dt * msh.getNode_v(i).norm() > dumax);
+            any_fast = any_fast || fast[i];
+            }
+        if (!any_fast) return 0;
+        growHalo(msh, fast, halo);
+        slow.resize(NOD);
+        int nb_fast(0);
+        for (int i = 0; i < NOD; i++)
+            {
+            slow[i] = !fast[i];
+            if (fast[i]) nb_fast++;
+            }
+        return nb_fast;
+        }
+
+    /** integrate the fast nodes over the coarse step t_prm with `factor' sub-steps, each one
+     * limited to dumax, the NEXT state holding the coarse step */
+    step_outcome advance(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+                         DemagSubCycling &demagCycle, Stats &stats, timing const &t_prm,
+                         const double dumax)
+        {
+        fem.msh.getState(Nodes::CURRENT, start);
+        fem.msh.getState(Nodes::NEXT, end);
+        const double vmax = fem.vmax;
+        thermal_start = linAlg.get_thermal_step();
+        linAlg.setIdleNodes(slow);
+        timing t_sub(t_prm);
+        t_sub.set_dt(t_prm.get_dt() / factor);
+        for (int k = 0; k < factor; k++)
+            {
+            t_sub.set_t(t_prm.get_t() + k * t_sub.get_dt());
+            if (solve_step(settings, linAlg, t_sub))
+                return fail(fem, linAlg, demagCycle, REJECTED_SOLVER);
+            if (t_sub.get_dt() * linAlg.get_v_max() > dumax)
+                return fail(fem, linAlg, demagCycle, REJECTED_DUMAX);
+
+            const double theta = double(k + 1) / factor;
+            for (unsigned int i = 0; i < slow.size(); i++)
+                if (slow[i])
+                    {
+                    Eigen::Vector3d u = (1 - theta) * start[i].u + theta * end[i].u;
+                    fem.msh.setNode_u(i, u.normalized());
+                    fem.msh.setNode_v(i, end[i].v);
+                    }
+            if (k + 1 < factor)
+                {
+                demagCycle.extrapolate(fem.msh, t_sub.get_dt());
+                fem.evolution();
+                }
+            else
+                compute_all(fem, settings, demagSol, demagCycle, stats, t_sub.get_t(),
+                            t_sub.get_dt());
+            linAlg.next_thermal_step();
+            }
+        linAlg.setIdleNodes(std::vector<bool>());
+        fem.vmax = vmax;
+        stats.multirate_steps++;
+        return ACCEPTED;
+        }
+    };
+
+/** integrate quietly from the NEXT state of fem, at time t_prm.get_t(), up to t_end: no output, no
+ * recentering. The steps are limited by dumax_limit, and the demag potentials are refreshed as
+ * given by demagEvery and demagMaxDu. Returns 0 on success, 1 if dt fell below its minimum or a
+ * signal was received. */
+int propagate(Fem &fem, Settings &settings, LinAlgebra &linAlg, demagSolver &demagSol,
+              timing &t_prm, const double t_end, const double dumax_limit, const int demagEvery,
+              const double demagMaxDu, int &nt)
+    {
+    DemagSubCycling demagCycle(demagEvery, demagMaxDu);
+    demagCycle.update(fem.msh, demagSol, 0);
     fem.evolution();
+    const bool pi_control = (settings.stepController == PI_CONTROLLER);
+    TimeStepper stepper(t_prm.get_dt(), t_prm.DTMIN, t_prm.DTMAX, pi_control ? 1 : 1.1);
+    PIController controller(settings.errTol);
+    bool first = true;
+    while (t_prm.get_t() < t_end)
+        {
+        extern volatile sig_atomic_t received_signal;  // set by signal_handler() in main.cpp
+        if (received_signal) return 1;
+        t_prm.set_dt(stepper(t_end - t_prm.get_t()));
+        bool last_step = (t_prm.get_dt() == t_end - t_prm.get_t());
+        if (t_prm.is_dt_TooSmall()) return 1;
+
+        double dumax, error;
+        if (try_step(fem, settings, linAlg, t_prm, stepper, controller, dumax_limit, first, dumax,
+                     error) != ACCEPTED)
+            continue;
+        if (pi_control) controller.accept(error);
+        demagCycle.update(fem.msh, demagSol, t_prm.get_dt());
+        fem.evolution();
+        linAlg.next_thermal_step();
+        nt++;
+        first = false;
+        if (last_step)
+            t_prm.set_t(t_end);
+        else
+            t_prm.inc_t();
+        }
+    return 0;
     }
 
 int time_integration(Fem &fem, Settings &settings /**< [in] */, LinAlgebra &linAlg /**< [in] */,
-                     scal_fmm::fmm &myFMM /**< [in] */, timing &t_prm, int &nt)
+                     demagSolver &demagSol /**< [in] */, timing &t_prm, int &nt)
     {
-    compute_all(fem, settings, myFMM, t_prm.get_t());
+    Stats stats;
+    DemagSubCycling demagCycle(settings.demagRefreshEvery, settings.demagRefreshDu);
+    compute_all(fem, settings, demagSol, demagCycle, stats, t_prm.get_t(), 0);
 
     std::string baseName = settings.r_path_output_dir + '/' + settings.getSimName();
     std::string str = baseName + ".evol";
@@ -157,28 +804,50 @@ int time_integration(Fem &fem, Settings &settings /**< [in] */, LinAlgebra &linA
     fout << settings.evolMetadata();
     fout.precision(16);  // extra precision needed to monitor relaxation towards equilibrium
 
+    std::ofstream fprobes;
+    if (!demagSol.probePhi.empty())
+        {
+        str = baseName + "_probes.evol";
+        fprobes.open(str);
+        if (fprobes.fail())
+            {
+            std::cout << "cannot open file " << str << std::endl;
+            SYSTEM_ERROR;
+            }
+        fprobes << settings.probesMetadata();
+        }
+
     int flag(0);
     int nt_output(0);  // visible iteration count
     int status(0);     // exit status
     double t_initial = t_prm.get_t();
     double t_step = settings.time_step;
     int step_count = std::round((t_prm.tf - t_initial) / t_step);
-    TimeStepper stepper(t_prm.get_dt(), t_prm.DTMIN, t_prm.DTMAX);
-    Stats stats;
+    const bool pi_control = (settings.stepController == PI_CONTROLLER);
+    double t_final = t_initial + step_count * t_step;
+    DenseOutput dense;
+    TimeStepper stepper(t_prm.get_dt(), t_prm.DTMIN, t_prm.DTMAX, pi_control ? 1 : 1.1);
+    PIController controller(settings.errTol);
+    EquilibriumDetector equilibrium;
+    ActiveSet activeSet(settings);
+    MultiRate multiRate(settings);
+    activeSet.reset(linAlg);  // idle nodes may be left from a previous run, e.g. of a hysteresis
 
     // Loop over the visible time steps, i.e. those that will appear on the output file.
     nt = 0;
     for (int step_nb = 0; step_nb <= step_count; step_nb++)
         {
         double t_target = t_initial + step_nb * t_step;
+        // with dense output, the steps only have to land on the final time
+        double t_stop = settings.denseOutput ? t_final : t_target;
 
         // Loop over the integration time steps within a visible step.
         while (t_prm.get_t() < t_target)
             {
             exit_if_signal_received(fem, settings, t_prm, stats);
 
-            t_prm.set_dt(stepper(t_target - t_prm.get_t()));
-            bool last_step = (t_prm.get_dt() == t_target - t_prm.get_t());
+            t_prm.set_dt(stepper(t_stop - t_prm.get_t()));
+            bool last_step = (t_prm.get_dt() == t_stop - t_prm.get_t());
 
             if (settings.verbose)
                 {
@@ -196,63 +865,101 @@ int time_integration(Fem &fem, Settings &settings /**< [in] */, LinAlgebra &linA
                 status = 1;
                 goto bailout;
                 }
-            linAlg.base_projection();
-            if(settings.getFieldType() == RtoR3)
+            double dumax, error;
+            step_outcome outcome = try_step(fem, settings, linAlg, t_prm, stepper, controller,
+                                            multiRate.coarse_dumax(settings.DUMAX), nt == 0,
+                                            dumax, error);
+            bool substepped(false);
+            if (outcome == ACCEPTED && multiRate.split(fem.msh, t_prm.get_dt(), settings.DUMAX))
                 {
-                Eigen::Vector3d Hext = settings.getField(t_prm.get_t());
-                linAlg.prepareElements(Hext, t_prm);
+                outcome = multiRate.advance(fem, settings, linAlg, demagSol, demagCycle, stats,
+                                            t_prm, settings.DUMAX);
+                if (outcome != ACCEPTED) stepper.set_soft_limit(t_prm.get_dt() / 2);
+                substepped = (outcome == ACCEPTED);
                 }
-            else if(settings.getFieldType() == R4toR3)
-                {
-                double amp_field_time = settings.getFieldTime(t_prm.get_t());
-                linAlg.prepareElements(amp_field_time,t_prm);
-                }
-
-            int err = linAlg.solver(t_prm);
-            fem.vmax = linAlg.get_v_max();
-
-            if (err)
+            if (outcome != ACCEPTED)
                 {
                 flag++;
-                stepper.set_soft_limit(t_prm.get_dt() / 2);
                 stats.bad_dt.add(t_prm.get_dt());
+                if (outcome == REJECTED_SOLVER)
+                    stats.rejected_solver++;
+                else if (outcome == REJECTED_DUMAX)
+                    stats.rejected_dumax++;
+                else
+                    stats.rejected_error++;
                 continue;
                 }
-
-            double dumax = t_prm.get_dt() * fem.vmax;
+            if (pi_control) controller.accept(error);
             stats.good_dt.add(t_prm.get_dt());
             stats.good_dumax.add(dumax);
-            if (settings.verbose)
-                {
-                std::cout << "  -> dumax = " << dumax << ",  vmax = " << fem.vmax << std::endl;
-                }
+            if (error > 0) stats.error.add(error);
 
-            stepper.set_soft_limit(settings.DUMAX / fem.vmax / 2);
-            if (dumax > settings.DUMAX)
+            if (settings.denseOutput) dense.store(fem.msh, t_prm.get_t());
+            if (!substepped)
                 {
-                flag++;
-                continue;
+                compute_all(fem, settings, demagSol, demagCycle, stats, t_prm.get_t(),
+                            t_prm.get_dt());
+                linAlg.next_thermal_step();
                 }
-
-            compute_all(fem, settings, myFMM, t_prm.get_t());
             nt++;
             flag = 0;
 
             // Prevent rounding errors from making us miss the target.
             if (last_step)
-                t_prm.set_t(t_target);
+                t_prm.set_t(t_stop);
             else
                 t_prm.inc_t();
 
-            if (settings.recenter) fem.recenter(settings.threshold, settings.recentering_direction);
+            activeSet.update(fem, settings, linAlg, stats, t_prm.get_t());
+            if (settings.recenter && fem.recenter(settings.threshold, settings.recentering_direction))
+                {
+                demagCycle.reset();
+                activeSet.reset(linAlg);
+                }
             if (!settings.verbose) show_progress(t_prm.get_t() / t_prm.tf);
+            if (equilibrium.check(fem, settings, t_prm.get_t())) break;
             }  // endwhile
-        fem.saver(settings, t_prm, fout, nt_output++);
+        if (settings.denseOutput && t_prm.get_t() > t_target)
+            {
+            timing t_out(t_prm);
+            t_out.set_t(t_target);
+            dense.interpolate(fem.msh, t_target, t_prm.get_t(),
+                              [&]()
+                              {
+                                  fem.energy(t_target, settings);
+                                  fem.saver(settings, t_out, fout, nt_output);
+                              });
+            nt_output++;
+            }
+        else
+            {
+            if (settings.denseOutput && !settings.verbose) fem.energy(t_prm.get_t(), settings);
+            fem.saver(settings, t_prm, fout, nt_output++);
+            }
+        if (fprobes.is_open())
+            save_probes(settings, t_prm.get_t(), demagSol, fprobes);
+        if (!equilibrium.reason.empty())
+            {
+            std::cout << "\nEquilibrium reached at t = " << t_prm.get_t() << " s: "
+                      << equilibrium.reason << '\n';
+            if (settings.denseOutput && t_prm.get_t() > t_target)
+                {  // only the interpolated state was written
+                fem.energy(t_prm.get_t(), settings);
+                fem.saver(settings, t_prm, fout, nt_output++);
+                }
+            std::string fileName = baseName + "_equilibrium.sol";
+            std::string metadata = settings.solMetadata(t_prm.get_t(), "idx\tmx\tmy\tmz\tphi");
+            metadata += tags::sol::stopped + ' ' + equilibrium.reason + '\n';
+            fem.msh.savesol(settings.getPrecision(), fileName, metadata);
+            std::cout << "Magnetization configuration saved to " << fileName << "\n";
+            break;
+            }
         }                                       // end for
     if (!settings.verbose) show_progress(1.0);  // show we are done
 
 bailout:
     fout.close();
-    print_stats(stats);
+    if (fprobes.is_open()) fprobes.close();
+    print_stats(stats, settings.stepController);
     return status;
     }
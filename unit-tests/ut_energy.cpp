@@ -109,4 +109,69 @@ BOOST_AUTO_TEST_CASE(demagEnergy, *boost::unit_test::tolerance(UT_TOL))
     BOOST_TEST( Nodes::sq(result_to_test - Edemag) == 0.0 );
     }
 
+/*---------------------------------------*/
+/* test: the energy gradient of a tetrahedron, used by the energy minimization, against centered
+finite differences of the exchange, anisotropy and zeeman energies */
+/*---------------------------------------*/
+
+BOOST_AUTO_TEST_CASE(energyGradient)
+    {
+    const int nbNod = 4;
+    std::vector<Nodes::Node> node;
+    dummyNodes<nbNod>(node);
+
+    unsigned sd = my_seed();
+    std::mt19937 gen(sd);
+    std::uniform_real_distribution<> distrib(0.0, 1.0);
+
+    for (int i = 0; i < nbNod; i++)
+        {
+        node[i].d[1].u = rand_vec3d(M_PI * distrib(gen), 2 * M_PI * distrib(gen));
+        node[i].d[1].phi = 0;
+        }
+    Tetra::Tet t(node, 0, {1, 2, 3, 4});
+
+    Tetra::prm param;
+    param.A = 1e-11;
+    param.J = 1.0;
+    param.K = 1e5 * distrib(gen);
+    param.uk = rand_vec3d(M_PI * distrib(gen), 2 * M_PI * distrib(gen));
+    param.K3 = 1e5 * distrib(gen);
+    param.ex = Eigen::Vector3d(1, 0, 0);
+    param.ey = Eigen::Vector3d(0, 1, 0);
+    param.ez = Eigen::Vector3d(0, 0, 1);
+    Eigen::Vector3d Hext(1e5 * distrib(gen), 1e5 * distrib(gen), 1e5 * distrib(gen));
+
+    auto energy = [&t, &param, &Hext]()
+        {
+        Eigen::Matrix<double,Nodes::DIM,Tetra::NPI> u,dudx,dudy,dudz;
+        t.interpolation(Nodes::get_u<Nodes::NEXT>, u, dudx, dudy, dudz);
+        return t.exchangeEnergy(param, dudx, dudy, dudz) + t.anisotropyEnergy(param, u)
+               + t.zeemanEnergy(param, Hext, u);
+        };
+
+    Eigen::Matrix<double,Nodes::DIM,Tetra::N> G;
+    G.setZero();
+    t.energyGradient(param, Hext, G);
+
+    const double h = 1e-6;
+    double err(0), norm(0);
+    for (int i = 0; i < Tetra::N; i++)
+        for (int k = 0; k < Nodes::DIM; k++)
+            {
+            Eigen::Vector3d &u = node[t.ind[i]].d[1].u;
+            const double u0 = u(k);
+            u(k) = u0 + h;
+            const double Ep = energy();
+            u(k) = u0 - h;
+            const double Em = energy();
+            u(k) = u0;
+            const double dE = (Ep - Em) / (2 * h);
+            err = std::max(err, fabs(G(k, i) + dE));
+            norm = std::max(norm, fabs(dE));
+            }
+    std::cout << "max error on the energy gradient: " << err << " / " << norm << std::endl;
+    BOOST_TEST(err < 1e-6 * norm);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
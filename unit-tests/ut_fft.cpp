@@ -0,0 +1,70 @@
+/*
+ * Test the fast Fourier transform defined in fft.h against a naive discrete Fourier transform.
+ */
+
+#define BOOST_TEST_MODULE fftTest
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+#include "fft.h"
+#include "ut_config.h"
+
+BOOST_AUTO_TEST_SUITE(ut_fft)
+
+BOOST_AUTO_TEST_CASE(transform_1d)
+    {
+    std::mt19937 gen(my_seed());
+    std::uniform_real_distribution<> distrib(-1.0, 1.0);
+
+    const int n = 64;
+    std::vector<std::complex<double>> a(n), a_hat(n, 0.0);
+    for (auto &x : a)
+        x = std::complex<double>(distrib(gen), distrib(gen));
+    for (int k = 0; k < n; k++)
+        for (int j = 0; j < n; j++)
+            a_hat[k] += a[j] * std::polar(1.0, -2 * M_PI * j * k / n);
+
+    std::vector<std::complex<double>> b(a);
+    fft::transform(b.data(), n, false);
+    double err(0);
+    for (int k = 0; k < n; k++)
+        err = std::max(err, std::abs(b[k] - a_hat[k]));
+    std::cout << "max error of the 1d transform: " << err << std::endl;
+    BOOST_TEST(err < 1e-12);
+    }
+
+BOOST_AUTO_TEST_CASE(transform_3d)
+    {
+    std::mt19937 gen(my_seed());
+    std::uniform_real_distribution<> distrib(-1.0, 1.0);
+
+    fft::grid3d g(8, 4, 16);
+    for (auto &x : g.data)
+        x = distrib(gen);
+    fft::grid3d g_ref(g);
+
+    // naive transform of a single mode
+    const int p(3), q(1), r(5);
+    std::complex<double> mode(0);
+    for (int k = 0; k < g.nz; k++)
+        for (int j = 0; j < g.ny; j++)
+            for (int i = 0; i < g.nx; i++)
+                mode += g.data[g.idx(i, j, k)]
+                        * std::polar(1.0, -2 * M_PI
+                                                  * (double(i * p) / g.nx + double(j * q) / g.ny
+                                                     + double(k * r) / g.nz));
+
+    g.forward();
+    BOOST_TEST(std::abs(g.data[g.idx(p, q, r)] - mode) < 1e-12);
+
+    // inverse transform is normalized
+    g.inverse();
+    double err(0);
+    for (unsigned int m = 0; m < g.data.size(); m++)
+        err = std::max(err, std::abs(g.data[m] - g_ref.data[m]));
+    std::cout << "max error of the 3d round trip: " << err << std::endl;
+    BOOST_TEST(err < 1e-14);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,176 @@
+/*
+ * Compare the fmm demag solver of fmm_demag.h against the direct summation of directSolver, on the
+ * small ellipsoid mesh of the examples. The single and double precision fast multipole algorithms
+ * are both run on the same charges, so that the rounding errors of the single precision one, used
+ * with ENABLE_FMM_FLOAT=ON, are measured against the double precision one.
+ */
+
+#define BOOST_TEST_MODULE fmmPrecisionTest
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <vector>
+
+#include "config.h"
+#include "feellgoodSettings.h"
+#include "fmm_demag.h"
+#include "mesh.h"
+
+#include "ut_config.h"
+
+/* settings of the ellipsoid mesh, all the other settings are the defaults */
+static void readEllipsoidSettings(Settings &settings)
+    {
+    settings.read(YAML::Load("mesh:\n"
+                             "  filename: ../examples/ellipsoid.msh\n"
+                             "  volume_regions:\n"
+                             "    ellipsoid_volume:\n"
+                             "      Js: 1\n"
+                             "  surface_regions:\n"
+                             "    ellipsoid_surface: {}\n"));
+    }
+
+/* potentials on the nodes */
+static std::vector<double> potentials(Mesh::mesh const &msh)
+    {
+    std::vector<double> phi(msh.getNbNodes());
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        phi[i] = msh.get(i, Nodes::get_phi<Nodes::NEXT>);
+    return phi;
+    }
+
+/* relative error in euclidian norm of the potentials on the nodes */
+static double rel_error(Mesh::mesh const &msh, std::vector<double> const &phi_ref)
+    {
+    std::vector<double> phi = potentials(msh);
+    double num(0), den(0);
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        {
+        num += Nodes::sq(phi[i] - phi_ref[i]);
+        den += Nodes::sq(phi_ref[i]);
+        }
+    return sqrt(num / den);
+    }
+
+/* potential and field of the charges srcDen on the point p, by direct summation */
+static void direct_probe(Mesh::mesh const &msh, std::vector<double> const &srcDen,
+                         Eigen::Vector3d const &p, double &phi, Eigen::Vector3d &H)
+    {
+    std::vector<Eigen::Vector3d> src;
+    for (Tetra::Tet const &tet : msh.tet)
+        {
+        Eigen::Matrix<double, Nodes::DIM, Tetra::NPI> gauss;
+        tet.getPtGauss(gauss);
+        for (int j = 0; j < Tetra::NPI; j++)
+            src.push_back(gauss.col(j));
+        }
+    for (Facette::Fac const &fac : msh.fac)
+        {
+        Eigen::Matrix<double, Nodes::DIM, Facette::NPI> gauss;
+        fac.getPtGauss(gauss);
+        for (int j = 0; j < Facette::NPI; j++)
+            src.push_back(gauss.col(j));
+        }
+    phi = 0;
+    H.setZero();
+    for (unsigned int j = 0; j < src.size(); j++)
+        {
+        Eigen::Vector3d r = p - src[j];
+        phi += srcDen[j] / r.norm();
+        H += srcDen[j] * r / (r.norm() * r.squaredNorm());
+        }
+    phi /= 4 * M_PI;
+    H /= 4 * M_PI;
+    }
+
+BOOST_AUTO_TEST_SUITE(ut_fmm_precision)
+
+BOOST_AUTO_TEST_CASE(fmm_vs_direct)
+    {
+    Settings settings;
+    readEllipsoidSettings(settings);
+    Mesh::mesh msh(settings);
+
+    // a random magnetization, so that there are both volume and surface charges
+    std::mt19937 gen(my_seed());
+    std::uniform_real_distribution<> distrib(-1.0, 1.0);
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        {
+        Eigen::Vector3d u(distrib(gen), distrib(gen), distrib(gen));
+        msh.setNode_u(i, u.normalized());
+        msh.setNode_v(i, Eigen::Vector3d::Zero());
+        }
+
+    directSolver reference(msh, settings.paramTetra, settings.paramFacette);
+    reference.calc_demag(msh);
+    std::vector<double> phi_ref = potentials(msh);
+
+    scal_fmm::fmm<scal_fmm::rotationKernel<double>> solver(msh, settings.paramTetra,
+                                                           settings.paramFacette, 1);
+    solver.calc_demag(msh);
+    double err = rel_error(msh, phi_ref);
+    std::vector<double> phi_double = potentials(msh);
+
+    scal_fmm::fmm<scal_fmm::rotationKernel<float>> solver_float(msh, settings.paramTetra,
+                                                                settings.paramFacette, 1);
+    solver_float.calc_demag(msh);
+    double err_float = rel_error(msh, phi_ref);
+    double err_rounding = rel_error(msh, phi_double);
+
+    scal_fmm::fmm<scal_fmm::rotationKernel<>> compressed(msh, settings.paramTetra,
+                                                         settings.paramFacette, 1,
+                                                         settings.fmmNearFieldRadius);
+    compressed.calc_demag(msh);
+    double err_compressed = rel_error(msh, phi_ref);
+
+    std::cout << "relative error of the potentials, double precision:   " << err << std::endl;
+    std::cout << "relative error of the potentials, single precision:   " << err_float << std::endl;
+    std::cout << "single precision against double precision:            " << err_rounding
+              << std::endl;
+    std::cout << "relative error of the potentials, source compression: " << err_compressed
+              << " (" << (ENABLE_FMM_FLOAT ? "single" : "double") << " precision)" << std::endl;
+
+    // P=9 truncation error
+    BOOST_TEST(err < 1e-4);
+    // single precision rounding errors are of the order of 1e-6, far below the truncation error
+    BOOST_TEST(err_rounding < 1e-5);
+    BOOST_TEST(err_float < 1e-4);
+    // the far field of an element is its total charge: a first order approximation
+    BOOST_TEST(err_compressed < 1e-2);
+    }
+
+BOOST_AUTO_TEST_CASE(probes)
+    {
+    Settings settings;
+    readEllipsoidSettings(settings);
+    Mesh::mesh msh(settings);
+    for (int i = 0; i < msh.getNbNodes(); i++)
+        {
+        Eigen::Vector3d p = msh.getNode_p(i);
+        msh.setNode_u(i, Eigen::Vector3d(1, p.z(), 0.1 * p.x()).normalized());
+        }
+
+    // the ellipsoid is about 8 x 8 x 30, centered on the origin
+    std::vector<Eigen::Vector3d> probes = {Eigen::Vector3d(0, 0, 25), Eigen::Vector3d(10, 0, 0),
+                                           Eigen::Vector3d(5, -6, 18)};
+    for (const double radius : {0.0, settings.fmmNearFieldRadius})
+        {
+        scal_fmm::fmm<scal_fmm::rotationKernel<>> solver(msh, settings.paramTetra,
+                                                         settings.paramFacette, 1, radius, probes);
+        solver.calc_phi(msh);
+        for (unsigned int k = 0; k < probes.size(); k++)
+            {
+            double phi;
+            Eigen::Vector3d H;
+            direct_probe(msh, solver.srcDen, probes[k], phi, H);
+            double err_phi = fabs(solver.probePhi[k] - phi) / fabs(phi);
+            double err_H = (solver.probeH[k] - H).norm() / H.norm();
+            std::cout << "probe " << k << (radius > 0 ? ", source compression" : "")
+                      << ": relative error on phi " << err_phi << ", on H " << err_H << std::endl;
+            BOOST_TEST(err_phi < (radius > 0 ? 1e-2 : 1e-4));
+            BOOST_TEST(err_H < (radius > 0 ? 1e-2 : 1e-4));
+            }
+        }
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+/*
+ * Test the hierarchical matrix defined in hmatrix.h against a direct summation.
+ */
+
+#define BOOST_TEST_MODULE hmatrixTest
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+#include "hmatrix.h"
+#include "ut_config.h"
+
+BOOST_AUTO_TEST_SUITE(ut_hmatrix)
+
+/* direct summation of y_i = sum_j q_j/|x_i - y_j| */
+static std::vector<double> direct_sum(std::vector<Eigen::Vector3d> const &targets,
+                                      std::vector<Eigen::Vector3d> const &sources,
+                                      std::vector<double> const &q)
+    {
+    std::vector<double> y(targets.size(), 0.0);
+    for (unsigned int i = 0; i < targets.size(); i++)
+        for (unsigned int j = 0; j < sources.size(); j++)
+            {
+            double r = (targets[i] - sources[j]).norm();
+            if (r > 0) y[i] += q[j] / r;
+            }
+    return y;
+    }
+
+/* relative error in euclidian norm */
+static double rel_error(std::vector<double> const &y, std::vector<double> const &y_ref)
+    {
+    double num(0), den(0);
+    for (unsigned int i = 0; i < y.size(); i++)
+        {
+        num += (y[i] - y_ref[i]) * (y[i] - y_ref[i]);
+        den += y_ref[i] * y_ref[i];
+        }
+    return sqrt(num / den);
+    }
+
+BOOST_AUTO_TEST_CASE(thin_film_cloud)
+    {
+    std::mt19937 gen(my_seed());
+    std::uniform_real_distribution<> distrib(0.0, 1.0);
+
+    // a thin film: targets and sources are interleaved in a 100x100x3 box
+    const int nbTargets(2000), nbSources(5000);
+    std::vector<Eigen::Vector3d> targets(nbTargets), sources(nbSources);
+    for (auto &p : targets)
+        p = Eigen::Vector3d(100 * distrib(gen), 100 * distrib(gen), 3 * distrib(gen));
+    for (auto &p : sources)
+        p = Eigen::Vector3d(100 * distrib(gen), 100 * distrib(gen), 3 * distrib(gen));
+    std::vector<double> q(nbSources);
+    for (auto &x : q)
+        x = distrib(gen) - 0.5;
+
+    std::vector<double> y_ref = direct_sum(targets, sources, q);
+
+    for (double eps : {1e-3, 1e-5})
+        {
+        hmat::hmatrix H(targets, sources, eps, 2.0, 32);
+        std::vector<double> y;
+        H.apply(q, y);
+        double err = rel_error(y, y_ref);
+        std::cout << "eps = " << eps << ": relative error = " << err
+                  << ", compression ratio = " << H.compressionRatio() << std::endl;
+        BOOST_TEST(err < 10 * eps);
+        BOOST_TEST(H.compressionRatio() < 1.0);
+        BOOST_TEST(H.nbLowRankBlocks() > 0);
+        }
+    }
+
+BOOST_AUTO_TEST_CASE(repeated_apply)
+    {
+    std::mt19937 gen(my_seed());
+    std::uniform_real_distribution<> distrib(-1.0, 1.0);
+
+    // a nanowire: elongated along z
+    const int nbPts(3000);
+    std::vector<Eigen::Vector3d> pts(nbPts);
+    for (auto &p : pts)
+        p = Eigen::Vector3d(distrib(gen), distrib(gen), 50 * distrib(gen));
+
+    hmat::hmatrix H(pts, pts, 1e-6, 2.0, 16);
+    std::vector<double> q1(nbPts), q2(nbPts), y1, y2;
+    for (int i = 0; i < nbPts; i++)
+        {
+        q1[i] = distrib(gen);
+        q2[i] = distrib(gen);
+        }
+
+    // the operator is compressed once, then applied as many times as needed
+    H.apply(q1, y1);
+    H.apply(q2, y2);
+    BOOST_TEST(rel_error(y1, direct_sum(pts, pts, q1)) < 1e-5);
+    BOOST_TEST(rel_error(y2, direct_sum(pts, pts, q2)) < 1e-5);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,87 @@
+#define BOOST_TEST_MODULE tetLocatorTest
+
+#include <boost/test/unit_test.hpp>
+
+#include <random>
+
+#include "tetLocator.h"
+#include "ut_config.h"
+
+BOOST_AUTO_TEST_SUITE(ut_tet_locator)
+
+/** unit cube split into six tetrahedrons along its diagonal (0,0,0)-(1,1,1) */
+static void cube(std::vector<Nodes::Node> &node, std::vector<Tetra::Tet> &tet)
+    {
+    Eigen::Vector3d zero(0, 0, 0);
+    node.clear();
+    for (int k = 0; k < 8; k++)
+        {
+        Eigen::Vector3d p(k & 1, (k >> 1) & 1, (k >> 2) & 1);
+        Nodes::Node n = {p, zero, zero, {{zero, zero, 0, 0}, {zero, zero, 0, 0}}};
+        node.push_back(n);
+        }
+    // vertices 0 and 7 with the paths of corners along the axes, indices starting from 1
+    tet.clear();
+    tet.push_back(Tetra::Tet(node, 0, {1, 2, 4, 8}));
+    tet.push_back(Tetra::Tet(node, 0, {1, 2, 6, 8}));
+    tet.push_back(Tetra::Tet(node, 0, {1, 3, 4, 8}));
+    tet.push_back(Tetra::Tet(node, 0, {1, 3, 7, 8}));
+    tet.push_back(Tetra::Tet(node, 0, {1, 5, 6, 8}));
+    tet.push_back(Tetra::Tet(node, 0, {1, 5, 7, 8}));
+    }
+
+/** \return the point of barycentric coordinates lambda in tetrahedron te */
+static Eigen::Vector3d point(std::vector<Nodes::Node> const &node, Tetra::Tet const &te,
+                             Eigen::Vector4d const &lambda)
+    {
+    Eigen::Vector3d p = Eigen::Vector3d::Zero();
+    for (int i = 0; i < Tetra::N; i++)
+        p += lambda(i) * node[te.ind[i]].p;
+    return p;
+    }
+
+BOOST_AUTO_TEST_CASE(points_inside, *boost::unit_test::tolerance(UT_TOL))
+    {
+    std::vector<Nodes::Node> node;
+    std::vector<Tetra::Tet> tet;
+    cube(node, tet);
+    TetLocator locator(tet, node);
+
+    std::mt19937 gen(my_seed());
+    std::uniform_real_distribution<> distrib(0.0, 1.0);
+    for (int k = 0; k < 1000; k++)
+        {
+        Eigen::Vector3d p(distrib(gen), distrib(gen), distrib(gen));
+        Eigen::Vector4d lambda;
+        const int t = locator.locate(p, lambda);
+        BOOST_REQUIRE(t >= 0);
+        BOOST_CHECK(lambda.minCoeff() >= -1e-12);
+        BOOST_TEST(lambda.sum() == 1.0);
+        BOOST_TEST((point(node, tet[t], lambda) - p).norm() == 0.0);
+        }
+    }
+
+BOOST_AUTO_TEST_CASE(points_outside, *boost::unit_test::tolerance(UT_TOL))
+    {
+    std::vector<Nodes::Node> node;
+    std::vector<Tetra::Tet> tet;
+    cube(node, tet);
+    TetLocator locator(tet, node);
+
+    // the closest tetrahedron is chosen, and the point is brought back on its faces
+    Eigen::Vector4d lambda;
+    const Eigen::Vector3d p(0.3, 0.6, -0.1);
+    const int t = locator.locate(p, lambda);
+    BOOST_REQUIRE(t >= 0);
+    BOOST_CHECK(lambda.minCoeff() >= 0);
+    BOOST_TEST(lambda.sum() == 1.0);
+    const Eigen::Vector3d q = point(node, tet[t], lambda);
+    BOOST_TEST(q.z() == 0.0);
+    BOOST_CHECK(q.minCoeff() >= 0 && q.maxCoeff() <= 1);
+    BOOST_CHECK((q - p).norm() < 0.2);
+
+    BOOST_CHECK(locator.locate(Eigen::Vector3d(1.5, 1.2, 1.1), lambda) >= 0);
+    BOOST_CHECK(lambda.minCoeff() >= 0);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+#define BOOST_TEST_MODULE thermalTest
+
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "philox.h"
+#include "ut_tools.h"
+#include "ut_config.h"
+
+BOOST_AUTO_TEST_SUITE(ut_thermal)
+
+/*-----------------------------------------------------
+
+ known answer tests of Philox4x32-10, from the reference implementation Random123
+
+---------------------------------------*/
+BOOST_AUTO_TEST_CASE(philox_known_answers)
+    {
+    Philox::counter r = Philox::philox4x32({0, 0, 0, 0}, {0, 0});
+    BOOST_CHECK(r == Philox::counter({0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+
+    r = Philox::philox4x32({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                           {0xffffffff, 0xffffffff});
+    BOOST_CHECK(r == Philox::counter({0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+
+    r = Philox::philox4x32({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                           {0xa4093822, 0x299f31d0});
+    BOOST_CHECK(r == Philox::counter({0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+    }
+
+BOOST_AUTO_TEST_CASE(normal3_order_independence)
+    {
+    // the noise of an element on a time step does not depend on what was drawn before
+    const uint64_t seed = my_seed();
+    Eigen::Vector3d a = Philox::normal3(seed, 12, 7);
+    for (uint32_t i = 0; i < 100; i++)
+        Philox::normal3(seed, 13, i);
+    BOOST_CHECK(Philox::normal3(seed, 12, 7) == a);
+    BOOST_CHECK(Philox::normal3(seed, 13, 7) != a);
+    BOOST_CHECK(Philox::normal3(seed, 12, 8) != a);
+    BOOST_CHECK(Philox::normal3(seed + 1, 12, 7) != a);
+    }
+
+BOOST_AUTO_TEST_CASE(normal3_moments)
+    {
+    const uint64_t seed = my_seed();
+    const int n = 1000000;
+    Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d cov = Eigen::Matrix3d::Zero();
+    for (int i = 0; i < n; i++)
+        {
+        Eigen::Vector3d x = Philox::normal3(seed, i / 1000, i % 1000);
+        mean += x;
+        cov += x * x.transpose();
+        }
+    mean /= n;
+    cov /= n;
+    std::cout << "mean = " << mean.transpose() << "\ncovariance =\n" << cov << std::endl;
+    // the standard deviation of the estimates is about 1/sqrt(n)
+    BOOST_CHECK(mean.cwiseAbs().maxCoeff() < 5e-3);
+    BOOST_CHECK((cov - Eigen::Matrix3d::Identity()).cwiseAbs().maxCoeff() < 1e-2);
+    }
+
+/*-----------------------------------------------------
+
+ cost of the thermal field in the assembly of a tetrahedron
+
+---------------------------------------*/
+BOOST_AUTO_TEST_CASE(thermal_field_overhead)
+    {
+    const int nbNod = 4;
+    std::vector<Nodes::Node> node;
+    dummyNodes<nbNod>(node);
+
+    unsigned sd = my_seed();
+    std::mt19937 gen(sd);
+    std::uniform_real_distribution<> distrib(0.0, 1.0);
+    for (int i = 0; i < nbNod; i++)
+        {
+        node[i].d[Nodes::CURRENT].u = rand_vec3d(M_PI * distrib(gen), 2 * M_PI * distrib(gen));
+        node[i].setBasis(M_2_PI * distrib(gen));
+        }
+
+    Tetra::Tet t(node, 0, {1, 2, 3, 4});
+    Tetra::prm param;
+    param.alpha_LLG = 0.5;
+    param.A = 0;  // the thermal field is the only field
+    param.J = 1.0;
+    param.K = 0;
+    param.uk = Eigen::Vector3d::UnitZ();
+    param.K3 = 0;
+    param.ex = Eigen::Vector3d::UnitX();
+    param.ey = Eigen::Vector3d::UnitY();
+    param.ez = Eigen::Vector3d::UnitZ();
+    timing prm_t(1e-9, 1e-14, 1e-12);
+    auto calc_Hext = [](Eigen::Ref<Eigen::Matrix<double, Nodes::DIM, Tetra::NPI>> H)
+        { H.setZero(); };
+
+    const int n = 100000;
+    auto run = [&](const double T)
+        {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < n; i++)
+            {
+            Eigen::Vector3d eta = (T > 0) ? Philox::normal3(sd, i, t.idx) : Eigen::Vector3d::Zero();
+            t.integrales(param, prm_t, calc_Hext, Nodes::IDX_UNDEF, 0, T, eta);
+            }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count() / n;
+        };
+    const double t0 = run(0);
+    Eigen::Matrix<double, 2 * Tetra::N, 1> L0 = t.Lp;
+    const double t1 = run(300);
+    std::cout << "Tet::integrales: " << 1e9 * t0 << " ns at T = 0, " << 1e9 * t1
+              << " ns at T = 300 K, overhead " << 100 * (t1 / t0 - 1) << " %" << std::endl;
+
+    // no field at zero temperature, a thermal field at positive temperature
+    BOOST_CHECK(L0.norm() == 0);
+    t.integrales(param, prm_t, calc_Hext, Nodes::IDX_UNDEF, 0, 0, Philox::normal3(sd, 0, 0));
+    BOOST_CHECK(t.Lp.norm() == 0);
+    t.integrales(param, prm_t, calc_Hext, Nodes::IDX_UNDEF, 0, 300, Philox::normal3(sd, 0, 0));
+    BOOST_CHECK(t.Lp.norm() > 0);
+    }
+
+BOOST_AUTO_TEST_SUITE_END()